@@ -0,0 +1,90 @@
+// Sweeps chunk resolutions, thresholds and terrain regions, and prints the
+// average cost of a chunk per meshing phase.
+//
+//     mesh_benchmark [n_repeats]
+
+#include "marching_cubes.cpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+
+struct Region {
+    const char* name;
+    int chunk_y;
+};
+
+// Default terrain of scripts/marching_cubes/noise.js: open air above the
+// surface level, the terrain surface, caves further down and solid rock below
+// the floor.
+const Region regions[] = { { "air", 5 }, { "surface", -1 }, { "caves", -6 }, { "solid", -10 } };
+const uint resolutions[] = { 16, 32, 64 };
+const float thresholds[] = { -0.2f, 0.2f, 0.6f };
+
+// Chunks per side of the square of chunks meshed in each region
+const int N_CHUNKS_SIDE = 4;
+
+
+int main(int argc, char** argv) {
+    uint n_repeats = argc > 1 ? atoi(argv[1]) : 3;
+
+    DensityFunction* density_function = createDensityFunction(0, 3, 0.2f, 0.15f, 4.0f, 4.0f, 5.0f, -8.0f, 1.0f);
+
+    printf("%-8s %4s %9s | %9s %9s %9s %9s %9s %9s | %8s %8s %10s %7s\n",
+        "region", "res", "threshold",
+        "chunk_ms", "noise", "classify", "emission", "normals", "copy",
+        "vertices", "tris", "KiB_alloc", "skipped");
+
+    for (const Region& region : regions) {
+        for (uint n_vertices : resolutions) {
+            for (float threshold : thresholds) {
+                double chunk_ms = 0.0;
+                double noise_fill_ms = 0.0, classification_ms = 0.0, vertex_emission_ms = 0.0, normals_ms = 0.0, copy_ms = 0.0;
+                double n_vertices_out = 0.0, n_triangles = 0.0, bytes_allocated = 0.0, cells_skipped = 0.0, cells_total = 0.0;
+                uint n_chunks = 0;
+
+                for (uint repeat = 0; repeat < n_repeats; repeat++) {
+                    for (int chunk_x = 0; chunk_x < N_CHUNKS_SIDE; chunk_x++) {
+                        for (int chunk_z = 0; chunk_z < N_CHUNKS_SIDE; chunk_z++) {
+                            Clock::time_point start = Clock::now();
+                            GeometryAttributes* geometry_attributes = getGeometryAttributes(
+                                chunk_x, region.chunk_y, chunk_z,
+                                n_vertices, n_vertices, n_vertices,
+                                10.0f, 10.0f, 10.0f,
+                                density_function,
+                                threshold
+                            );
+                            chunk_ms += elapsedMs(start);
+
+                            const MeshStats& stats = geometry_attributes->stats;
+                            noise_fill_ms += stats.noise_fill_ms;
+                            classification_ms += stats.classification_ms;
+                            vertex_emission_ms += stats.vertex_emission_ms;
+                            normals_ms += stats.normals_ms;
+                            copy_ms += stats.copy_ms;
+                            n_vertices_out += stats.n_vertices;
+                            n_triangles += stats.n_triangles;
+                            bytes_allocated += stats.bytes_allocated;
+                            cells_skipped += stats.cells_skipped;
+                            cells_total += stats.cells_total;
+                            n_chunks++;
+
+                            releaseGeometry(geometry_attributes);
+                        }
+                    }
+                }
+
+                printf("%-8s %4u %9.2f | %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f | %8.0f %8.0f %10.1f %6.1f%%\n",
+                    region.name, n_vertices, threshold,
+                    chunk_ms / n_chunks,
+                    noise_fill_ms / n_chunks, classification_ms / n_chunks, vertex_emission_ms / n_chunks,
+                    normals_ms / n_chunks, copy_ms / n_chunks,
+                    n_vertices_out / n_chunks, n_triangles / n_chunks, bytes_allocated / n_chunks / 1024.0,
+                    100.0 * cells_skipped / cells_total);
+            }
+        }
+    }
+
+    deleteDensityFunction(density_function);
+    return 0;
+}
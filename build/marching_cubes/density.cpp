@@ -0,0 +1,175 @@
+#include <cstdint>
+
+
+const uint32_t MAX_OCTAVES = 8;
+
+
+// Terrain density, the native counterpart of createNoise in
+// scripts/marching_cubes/noise.js. Positions are in chunk coordinates. Octave i
+// is seeded with seed + i, so seed 0 gives the field of noise.js, which seeds
+// octave i with new Mash(i), up to float precision.
+struct DensityFunction {
+    uint32_t seed;
+    uint32_t n_octaves;
+    float frequency;
+    float persistence;
+    float lacunarity;
+
+    float surface_level;
+    float surface_transition_height;
+    float floor_level;
+    float floor_transition_height;
+
+    float octave_frequency[MAX_OCTAVES];
+    float octave_amplitude[MAX_OCTAVES];
+    uint8_t perm[MAX_OCTAVES][256];
+};
+
+
+static inline float clampf(float value, float min, float max) {
+    return value < min ? min : (value > max ? max : value);
+}
+
+
+// Derives the per-octave tables from the fBm parameters and the seed
+void initDensityFunction(DensityFunction& density_function) {
+    if (density_function.n_octaves > MAX_OCTAVES) density_function.n_octaves = MAX_OCTAVES;
+
+    float octave_frequency = density_function.frequency;
+    float octave_amplitude = 1.0f;
+    for (uint32_t octave = 0; octave < density_function.n_octaves; octave++) {
+        density_function.octave_frequency[octave] = octave_frequency;
+        density_function.octave_amplitude[octave] = octave_amplitude;
+        fillPermutation(density_function.perm[octave], density_function.seed + octave);
+
+        octave_frequency *= density_function.lacunarity;
+        octave_amplitude *= density_function.persistence;
+    }
+}
+
+
+static inline float surfaceMask(const DensityFunction& density_function, float y) {
+    return clampf((density_function.surface_level - y) / density_function.surface_transition_height, 0.0f, 1.0f);
+}
+
+
+static inline float floorMask(const DensityFunction& density_function, float y) {
+    return clampf((y - density_function.floor_level) / density_function.floor_transition_height, 0.0f, 1.0f);
+}
+
+
+// Clamps the fBm sum and applies the vertical masks, which only depend on y
+static inline float applyMasks(float value, float surface_mask, float floor_mask) {
+    value = clampf(value, -1.0f, 1.0f);
+    value = (value + 1.0f) * surface_mask - 1.0f;
+    value = (value - 1.0f) * floor_mask + 1.0f;
+    return value;
+}
+
+
+// Conservative range of the density over the slab y_min <= y <= y_max. The fBm
+// sum is clamped to [-1, 1] and the masks are monotonic in y, so the range only
+// depends on the masks at both ends of the slab.
+void densityBounds(const DensityFunction& density_function, float y_min, float y_max, float& min_value, float& max_value) {
+    float surface_mask_max = surfaceMask(density_function, y_min);
+    float floor_mask_min = floorMask(density_function, y_min);
+    float floor_mask_max = floorMask(density_function, y_max);
+
+    min_value = applyMasks(-1.0f, surface_mask_max, floor_mask_max);
+    max_value = applyMasks(1.0f, surface_mask_max, floor_mask_min);
+}
+
+
+float density(const DensityFunction& density_function, float x, float y, float z) {
+    float value = 0.0f;
+    for (uint32_t octave = 0; octave < density_function.n_octaves; octave++) {
+        float octave_frequency = density_function.octave_frequency[octave];
+        value += density_function.octave_amplitude[octave] * noise(
+            x * octave_frequency, y * octave_frequency, z * octave_frequency,
+            density_function.perm[octave]
+        );
+    }
+
+    return applyMasks(value, surfaceMask(density_function, y), floorMask(density_function, y));
+}
+
+
+// Same as density(x, y, z), also writing the analytic gradient in (dx, dy, dz).
+// The gradient is zero where the masks flatten the field completely.
+float density(const DensityFunction& density_function, float x, float y, float z, float& dx, float& dy, float& dz) {
+    float value = 0.0f;
+    dx = 0.0f; dy = 0.0f; dz = 0.0f;
+    for (uint32_t octave = 0; octave < density_function.n_octaves; octave++) {
+        float octave_frequency = density_function.octave_frequency[octave];
+        float octave_amplitude = density_function.octave_amplitude[octave];
+        float gx, gy, gz;
+        value += octave_amplitude * noise(
+            x * octave_frequency, y * octave_frequency, z * octave_frequency,
+            gx, gy, gz,
+            density_function.perm[octave]
+        );
+        dx += octave_amplitude * octave_frequency * gx;
+        dy += octave_amplitude * octave_frequency * gy;
+        dz += octave_amplitude * octave_frequency * gz;
+    }
+
+    // The clamp flattens the field but not the direction of the surface where
+    // it reaches -1 or 1, so the gradient is kept from the unclamped sum
+    value = clampf(value, -1.0f, 1.0f);
+
+    // The masks are linear ramps in y, flat outside their transition band
+    float surface_ramp = (density_function.surface_level - y) / density_function.surface_transition_height;
+    float surface_mask = clampf(surface_ramp, 0.0f, 1.0f);
+    float surface_slope = (surface_ramp > 0.0f && surface_ramp < 1.0f) ? -1.0f / density_function.surface_transition_height : 0.0f;
+
+    float floor_ramp = (y - density_function.floor_level) / density_function.floor_transition_height;
+    float floor_mask = clampf(floor_ramp, 0.0f, 1.0f);
+    float floor_slope = (floor_ramp > 0.0f && floor_ramp < 1.0f) ? 1.0f / density_function.floor_transition_height : 0.0f;
+
+    float surface_value = (value + 1.0f) * surface_mask - 1.0f;
+    dx *= surface_mask;
+    dy = dy * surface_mask + (value + 1.0f) * surface_slope;
+    dz *= surface_mask;
+
+    dx *= floor_mask;
+    dy = dy * floor_mask + (surface_value - 1.0f) * floor_slope;
+    dz *= floor_mask;
+
+    return (surface_value - 1.0f) * floor_mask + 1.0f;
+}
+
+
+// Fills out[i] with the density at (x, y, z[i]). scratch must hold 2 * count floats.
+void densityRow(
+    const DensityFunction& density_function,
+    float x, float y, const float* z,
+    float* out, uint32_t count,
+    float* scratch
+) {
+    float* octave_z = scratch;
+    float* octave_values = scratch + count;
+
+    for (uint32_t idx = 0; idx < count; idx++) {
+        out[idx] = 0.0f;
+    }
+
+    for (uint32_t octave = 0; octave < density_function.n_octaves; octave++) {
+        float octave_frequency = density_function.octave_frequency[octave];
+        float octave_amplitude = density_function.octave_amplitude[octave];
+
+        for (uint32_t idx = 0; idx < count; idx++) {
+            octave_z[idx] = z[idx] * octave_frequency;
+        }
+        noiseRow(x * octave_frequency, y * octave_frequency, octave_z, octave_values, count, density_function.perm[octave]);
+
+        for (uint32_t idx = 0; idx < count; idx++) {
+            out[idx] += octave_amplitude * octave_values[idx];
+        }
+    }
+
+    float surface_mask = surfaceMask(density_function, y);
+    float floor_mask = floorMask(density_function, y);
+    for (uint32_t idx = 0; idx < count; idx++) {
+        out[idx] = applyMasks(out[idx], surface_mask, floor_mask);
+    }
+}
@@ -0,0 +1,136 @@
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+
+// Identifies a density grid: the chunk, its resolution and every parameter the
+// density function was built from. Fields are compared bitwise.
+struct DensityKey {
+    int32_t chunk_x, chunk_y, chunk_z;
+    uint32_t n_vertices_x, n_vertices_y, n_vertices_z;
+
+    uint32_t seed;
+    uint32_t n_octaves;
+    float frequency;
+    float persistence;
+    float lacunarity;
+    float surface_level;
+    float surface_transition_height;
+    float floor_level;
+    float floor_transition_height;
+
+    bool operator==(const DensityKey& other) const {
+        return memcmp(this, &other, sizeof(DensityKey)) == 0;
+    }
+};
+
+
+struct DensityKeyHash {
+    size_t operator()(const DensityKey& key) const {
+        // FNV-1a over the key bytes
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&key);
+        uint32_t hash = 2166136261u;
+        for (size_t idx = 0; idx < sizeof(DensityKey); idx++) {
+            hash = (hash ^ bytes[idx]) * 16777619u;
+        }
+        return hash;
+    }
+};
+
+
+DensityKey makeDensityKey(
+    const DensityFunction& density_function,
+    int32_t chunk_x, int32_t chunk_y, int32_t chunk_z,
+    uint32_t n_vertices_x, uint32_t n_vertices_y, uint32_t n_vertices_z
+) {
+    DensityKey key;
+    memset(&key, 0, sizeof(DensityKey));
+
+    key.chunk_x = chunk_x; key.chunk_y = chunk_y; key.chunk_z = chunk_z;
+    key.n_vertices_x = n_vertices_x; key.n_vertices_y = n_vertices_y; key.n_vertices_z = n_vertices_z;
+
+    key.seed = density_function.seed;
+    key.n_octaves = density_function.n_octaves;
+    key.frequency = density_function.frequency;
+    key.persistence = density_function.persistence;
+    key.lacunarity = density_function.lacunarity;
+    key.surface_level = density_function.surface_level;
+    key.surface_transition_height = density_function.surface_transition_height;
+    key.floor_level = density_function.floor_level;
+    key.floor_transition_height = density_function.floor_transition_height;
+    return key;
+}
+
+
+// Least recently used density grids, bounded by a budget in bytes. Grids are
+// shared so an eviction never frees a grid that is still being meshed.
+class DensityCache {
+public:
+    typedef std::shared_ptr<const std::vector<float>> Field;
+
+    explicit DensityCache(size_t budget_bytes) : budget_bytes(budget_bytes) {}
+
+    // Cached grid for the key, or null. A hit makes the grid the most recent.
+    Field find(const DensityKey& key) {
+        std::lock_guard<std::mutex> lock(cache_lock);
+
+        auto found = index.find(key);
+        if (found == index.end()) {
+            return Field();
+        }
+
+        entries.splice(entries.begin(), entries, found->second);
+        return found->second->field;
+    }
+
+    void insert(const DensityKey& key, Field field) {
+        size_t field_bytes = field->size() * sizeof(float);
+        if (field_bytes > budget_bytes) return;
+
+        std::lock_guard<std::mutex> lock(cache_lock);
+
+        auto found = index.find(key);
+        if (found != index.end()) {
+            used_bytes -= found->second->field->size() * sizeof(float);
+            entries.erase(found->second);
+            index.erase(found);
+        }
+
+        while (used_bytes + field_bytes > budget_bytes) {
+            used_bytes -= entries.back().field->size() * sizeof(float);
+            index.erase(entries.back().key);
+            entries.pop_back();
+        }
+
+        entries.push_front({ key, std::move(field) });
+        index[key] = entries.begin();
+        used_bytes += field_bytes;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(cache_lock);
+        entries.clear();
+        index.clear();
+        used_bytes = 0;
+    }
+
+    size_t bytes() {
+        std::lock_guard<std::mutex> lock(cache_lock);
+        return used_bytes;
+    }
+
+private:
+    struct Entry {
+        DensityKey key;
+        Field field;
+    };
+
+    std::mutex cache_lock;
+    std::list<Entry> entries;
+    std::unordered_map<DensityKey, std::list<Entry>::iterator, DensityKeyHash> index;
+    size_t budget_bytes;
+    size_t used_bytes = 0;
+};
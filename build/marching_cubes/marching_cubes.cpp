@@ -1,169 +1,601 @@
 #include "marching_cubes.h"
 
 
-float3 getNormal(float x, float y, float z) {
-    float nx = (noise(x - EPSILON, y, z) - noise(x + EPSILON, y, z)) / (2 * EPSILON);
-    float ny = (noise(x, y - EPSILON, z) - noise(x, y + EPSILON, z)) / (2 * EPSILON);
-    float nz = (noise(x, y, z - EPSILON) - noise(x, y, z + EPSILON)) / (2 * EPSILON);
+typedef chrono::steady_clock Clock;
+
+static inline float elapsedMs(Clock::time_point start) {
+    return chrono::duration<float, milli>(Clock::now() - start).count();
+}
+
+
+// Step, in chunk coordinates, of the central differences of getNormalChunkCoords
+// in scripts/marching_cubes/marching_cubes.js
+const float NORMAL_EPSILON = 0.05f;
+
+
+// Normal at a world-space position, from the analytic gradient of the density
+// field. The field is sampled in chunk coordinates, position / chunk_size.
+// Where the gradient vanishes, as on the flat side of a mask, it falls back to
+// central differences like the JS mesher, then to the up vector.
+float3 getNormal(
+    const DensityFunction& density_function,
+    float x, float y, float z,
+    float chunk_size_x, float chunk_size_y, float chunk_size_z
+) {
+    float chunk_x = x / chunk_size_x;
+    float chunk_y = y / chunk_size_y;
+    float chunk_z = z / chunk_size_z;
+
+    float dx, dy, dz;
+    density(density_function, chunk_x, chunk_y, chunk_z, dx, dy, dz);
+
+    if (dx == 0.0f && dy == 0.0f && dz == 0.0f) {
+        dx = density(density_function, chunk_x + NORMAL_EPSILON, chunk_y, chunk_z) - density(density_function, chunk_x - NORMAL_EPSILON, chunk_y, chunk_z);
+        dy = density(density_function, chunk_x, chunk_y + NORMAL_EPSILON, chunk_z) - density(density_function, chunk_x, chunk_y - NORMAL_EPSILON, chunk_z);
+        dz = density(density_function, chunk_x, chunk_y, chunk_z + NORMAL_EPSILON) - density(density_function, chunk_x, chunk_y, chunk_z - NORMAL_EPSILON);
+    }
+
+    float nx = -dx / chunk_size_x;
+    float ny = -dy / chunk_size_y;
+    float nz = -dz / chunk_size_z;
 
     float length = sqrt(nx*nx + ny*ny + nz*nz);
+    if (length == 0.0f) {
+        return { 0.0f, 1.0f, 0.0f };
+    }
 
     return { nx / length, ny / length, nz / length };
 }
 
 
-uint8_t getCubeIdx(float*** noise_values, uint x_idx, uint y_idx, uint z_idx, float threshold) {
+DensityFunction* createDensityFunction(
+    uint seed, uint n_octaves,
+    float frequency, float persistence, float lacunarity,
+    float surface_level, float surface_transition_height,
+    float floor_level, float floor_transition_height
+) {
+    DensityFunction* density_function = new DensityFunction();
+
+    density_function->seed = seed;
+    density_function->n_octaves = n_octaves;
+    density_function->frequency = frequency;
+    density_function->persistence = persistence;
+    density_function->lacunarity = lacunarity;
+    density_function->surface_level = surface_level;
+    density_function->surface_transition_height = surface_transition_height;
+    density_function->floor_level = floor_level;
+    density_function->floor_transition_height = floor_transition_height;
+    initDensityFunction(*density_function);
+
+    return density_function;
+}
+
+
+void deleteDensityFunction(DensityFunction* density_function) {
+    delete density_function;
+}
+
+
+uint8_t getCubeIdx(const DensityGrid& grid, uint x_idx, uint y_idx, uint z_idx, float threshold) {
     uint8_t cube_index = 0;
 
-    if (noise_values[x_idx][y_idx][z_idx] < threshold) cube_index |= 1;
-    if (noise_values[x_idx + 1][y_idx][z_idx] < threshold) cube_index |= 2;
-    if (noise_values[x_idx + 1][y_idx + 1][z_idx] < threshold) cube_index |= 4;
-    if (noise_values[x_idx][y_idx + 1][z_idx] < threshold) cube_index |= 8;
-    if (noise_values[x_idx][y_idx][z_idx + 1] < threshold) cube_index |= 16;
-    if (noise_values[x_idx + 1][y_idx][z_idx + 1] < threshold) cube_index |= 32;
-    if (noise_values[x_idx + 1][y_idx + 1][z_idx + 1] < threshold) cube_index |= 64;
-    if (noise_values[x_idx][y_idx + 1][z_idx + 1] < threshold) cube_index |= 128;
+    if (grid.at(x_idx, y_idx, z_idx) < threshold) cube_index |= 1;
+    if (grid.at(x_idx + 1, y_idx, z_idx) < threshold) cube_index |= 2;
+    if (grid.at(x_idx + 1, y_idx + 1, z_idx) < threshold) cube_index |= 4;
+    if (grid.at(x_idx, y_idx + 1, z_idx) < threshold) cube_index |= 8;
+    if (grid.at(x_idx, y_idx, z_idx + 1) < threshold) cube_index |= 16;
+    if (grid.at(x_idx + 1, y_idx, z_idx + 1) < threshold) cube_index |= 32;
+    if (grid.at(x_idx + 1, y_idx + 1, z_idx + 1) < threshold) cube_index |= 64;
+    if (grid.at(x_idx, y_idx + 1, z_idx + 1) < threshold) cube_index |= 128;
 
     return cube_index;
 }
 
 
-CubeInfo* getCubeInfo(
-    float*** noise_values,
+uint getEdgeVertex(
+    GeometryConstructor& geometry_constructor,
+    EdgeCache& edge_cache,
+    const DensityGrid& grid,
     uint x_idx, uint y_idx, uint z_idx,
-    uint16_t edges,
+    uint8_t edge,
     float ratio_x, float ratio_y, float ratio_z,
-    int chunk_pos_x, int chunk_pos_y, int chunk_pos_z,
+    float chunk_pos_x, float chunk_pos_y, float chunk_pos_z,
     float threshold
 ) {
-    CubeInfo* cube_info = new CubeInfo();
-
-    if (edges & 1) {
-        cube_info->indices[0] = cube_info->positions.size() / 3;
-        float mu = (threshold - noise_values[x_idx][y_idx][z_idx]) / (noise_values[x_idx + 1][y_idx][z_idx] - noise_values[x_idx][y_idx][z_idx]);
-        cube_info->positions.push_back((x_idx + mu)*ratio_x + chunk_pos_x);
-        cube_info->positions.push_back(y_idx*ratio_y + chunk_pos_y);
-        cube_info->positions.push_back(z_idx*ratio_z + chunk_pos_z);
-    }
-    if (edges & 2) {
-        cube_info->indices[1] = cube_info->positions.size() / 3;
-        float mu = (threshold - noise_values[x_idx + 1][y_idx][z_idx]) / (noise_values[x_idx + 1][y_idx + 1][z_idx] - noise_values[x_idx + 1][y_idx][z_idx]);
-        cube_info->positions.push_back((x_idx + 1)*ratio_x + chunk_pos_x);
-		cube_info->positions.push_back((y_idx + mu)*ratio_y + chunk_pos_y);
-		cube_info->positions.push_back(z_idx*ratio_z + chunk_pos_z);
-    }
-    if (edges & 4) {
-        cube_info->indices[2] = cube_info->positions.size() / 3;
-        float mu = (threshold - noise_values[x_idx][y_idx + 1][z_idx]) / (noise_values[x_idx + 1][y_idx + 1][z_idx] - noise_values[x_idx][y_idx + 1][z_idx]);
-        cube_info->positions.push_back((x_idx + mu)*ratio_x + chunk_pos_x);
-		cube_info->positions.push_back((y_idx + 1)*ratio_y + chunk_pos_y);
-		cube_info->positions.push_back(z_idx*ratio_z + chunk_pos_z);
-    }
-    if (edges & 8) {
-        cube_info->indices[3] = cube_info->positions.size() / 3;
-        float mu = (threshold - noise_values[x_idx][y_idx][z_idx]) / (noise_values[x_idx][y_idx + 1][z_idx] - noise_values[x_idx][y_idx][z_idx]);
-        cube_info->positions.push_back(x_idx*ratio_x + chunk_pos_x);
-		cube_info->positions.push_back((y_idx + mu)*ratio_y + chunk_pos_y);
-		cube_info->positions.push_back(z_idx*ratio_z + chunk_pos_z);
-    }
-    if (edges & 16) {
-        cube_info->indices[4] = cube_info->positions.size() / 3;
-        float mu = (threshold - noise_values[x_idx][y_idx][z_idx + 1]) / (noise_values[x_idx + 1][y_idx][z_idx + 1] - noise_values[x_idx][y_idx][z_idx + 1]);
-        cube_info->positions.push_back((x_idx + mu)*ratio_x + chunk_pos_x);
-		cube_info->positions.push_back(y_idx*ratio_y + chunk_pos_y);
-		cube_info->positions.push_back((z_idx + 1)*ratio_z + chunk_pos_z);
-    }
-    if (edges & 32) {
-        cube_info->indices[5] = cube_info->positions.size() / 3;
-        float mu = (threshold - noise_values[x_idx + 1][y_idx][z_idx + 1]) / (noise_values[x_idx + 1][y_idx + 1][z_idx + 1] - noise_values[x_idx + 1][y_idx][z_idx + 1]);
-        cube_info->positions.push_back((x_idx + 1)*ratio_x + chunk_pos_x);
-		cube_info->positions.push_back((y_idx + mu)*ratio_y + chunk_pos_y);
-		cube_info->positions.push_back((z_idx + 1)*ratio_z + chunk_pos_z);
-    }
-    if (edges & 64) {
-        cube_info->indices[6] = cube_info->positions.size() / 3;
-        float mu = (threshold - noise_values[x_idx][y_idx + 1][z_idx + 1]) / (noise_values[x_idx + 1][y_idx + 1][z_idx + 1] - noise_values[x_idx][y_idx + 1][z_idx + 1]);
-        cube_info->positions.push_back((x_idx + mu)*ratio_x + chunk_pos_x);
-		cube_info->positions.push_back((y_idx + 1)*ratio_y + chunk_pos_y);
-		cube_info->positions.push_back((z_idx + 1)*ratio_z + chunk_pos_z);
-    }
-    if (edges & 128) {
-        cube_info->indices[7] = cube_info->positions.size() / 3;
-        float mu = (threshold - noise_values[x_idx][y_idx][z_idx + 1]) / (noise_values[x_idx][y_idx + 1][z_idx + 1] - noise_values[x_idx][y_idx][z_idx + 1]);
-        cube_info->positions.push_back(x_idx*ratio_x + chunk_pos_x);
-		cube_info->positions.push_back((y_idx + mu)*ratio_y + chunk_pos_y);
-		cube_info->positions.push_back((z_idx + 1)*ratio_z + chunk_pos_z);
-    }
-    if (edges & 256) {
-        cube_info->indices[8] = cube_info->positions.size() / 3;
-        float mu = (threshold - noise_values[x_idx][y_idx][z_idx]) / (noise_values[x_idx][y_idx][z_idx + 1] - noise_values[x_idx][y_idx][z_idx]);
-        cube_info->positions.push_back(x_idx*ratio_x + chunk_pos_x);
-		cube_info->positions.push_back(y_idx*ratio_y + chunk_pos_y);
-		cube_info->positions.push_back((z_idx + mu)*ratio_z + chunk_pos_z);
-    }
-    if (edges & 512) {
-        cube_info->indices[9] = cube_info->positions.size() / 3;
-        float mu = (threshold - noise_values[x_idx + 1][y_idx][z_idx]) / (noise_values[x_idx + 1][y_idx][z_idx + 1] - noise_values[x_idx + 1][y_idx][z_idx]);
-        cube_info->positions.push_back((x_idx + 1)*ratio_x + chunk_pos_x);
-		cube_info->positions.push_back(y_idx*ratio_y + chunk_pos_y);
-		cube_info->positions.push_back((z_idx + mu)*ratio_z + chunk_pos_z);
-    }
-    if (edges & 1024) {
-        cube_info->indices[10] = cube_info->positions.size() / 3;
-        float mu = (threshold - noise_values[x_idx + 1][y_idx + 1][z_idx]) / (noise_values[x_idx + 1][y_idx + 1][z_idx + 1] - noise_values[x_idx + 1][y_idx + 1][z_idx]);
-        cube_info->positions.push_back((x_idx + 1)*ratio_x + chunk_pos_x);
-		cube_info->positions.push_back((y_idx + 1)*ratio_y + chunk_pos_y);
-		cube_info->positions.push_back((z_idx + mu)*ratio_z + chunk_pos_z);
-    }
-    if (edges & 2048) {
-        cube_info->indices[11] = cube_info->positions.size() / 3;
-        float mu = (threshold - noise_values[x_idx][y_idx + 1][z_idx]) / (noise_values[x_idx][y_idx + 1][z_idx + 1] - noise_values[x_idx][y_idx + 1][z_idx]);
-        cube_info->positions.push_back(x_idx*ratio_x + chunk_pos_x);
-		cube_info->positions.push_back((y_idx + 1)*ratio_y + chunk_pos_y);
-		cube_info->positions.push_back((z_idx + mu)*ratio_z + chunk_pos_z);
-    }
-
-    return cube_info;
-}
-
-
-GeometryAttributes* getGeometryAttributesFromConstructor(GeometryConstructor* geometry_constructor) {
-    GeometryAttributes* geometry_attributes = new GeometryAttributes();
+    const uint8_t* origin = edgeOrigin[edge];
+    uint x0 = x_idx + origin[0];
+    uint y0 = y_idx + origin[1];
+    uint z0 = z_idx + origin[2];
+    uint8_t axis = origin[3];
 
-    geometry_attributes->positions_size = geometry_constructor->positions.size();
-    geometry_attributes->positions = new float[geometry_attributes->positions_size];
-    copy(geometry_constructor->positions.begin(), geometry_constructor->positions.end(), geometry_attributes->positions);
+    uint& vertex_idx = edge_cache.at(x0, y0, z0, axis);
+    if (vertex_idx != NO_VERTEX) {
+        return vertex_idx;
+    }
 
-    geometry_attributes->indices_size = geometry_constructor->indices.size();
-    geometry_attributes->indices = new uint[geometry_attributes->indices_size];
-    copy(geometry_constructor->indices.begin(), geometry_constructor->indices.end(), geometry_attributes->indices);
+    float value_0 = grid.at(x0, y0, z0);
+    float value_1 = grid.at(x0 + (axis == 0), y0 + (axis == 1), z0 + (axis == 2));
+    float mu = (threshold - value_0) / (value_1 - value_0);
 
-    geometry_attributes->normals_size = geometry_constructor->positions.size();
-    geometry_attributes->normals = new float[geometry_attributes->normals_size];
-    for (uint i = 0; i < geometry_attributes->normals_size; i += 3) {
+    float x = x0, y = y0, z = z0;
+    if (axis == 0) x += mu;
+    else if (axis == 1) y += mu;
+    else z += mu;
+
+    vertex_idx = geometry_constructor.positions.size() / 3;
+    geometry_constructor.positions.push_back(x*ratio_x + chunk_pos_x);
+    geometry_constructor.positions.push_back(y*ratio_y + chunk_pos_y);
+    geometry_constructor.positions.push_back(z*ratio_z + chunk_pos_z);
+
+    return vertex_idx;
+}
+
+
+void computeNormals(
+    GeometryConstructor& geometry_constructor,
+    const DensityFunction& density_function,
+    float chunk_size_x, float chunk_size_y, float chunk_size_z
+) {
+    const vector<float>& positions = geometry_constructor.positions;
+    vector<float>& normals = geometry_constructor.normals;
+
+    normals.resize(positions.size());
+    for (uint i = 0; i < positions.size(); i += 3) {
         float3 normal = getNormal(
-            geometry_attributes->positions[i],
-            geometry_attributes->positions[i + 1],
-            geometry_attributes->positions[i + 2]
+            density_function,
+            positions[i], positions[i + 1], positions[i + 2],
+            chunk_size_x, chunk_size_y, chunk_size_z
         );
 
-        geometry_attributes->normals[i] = normal.x;
-        geometry_attributes->normals[i + 1] = normal.y;
-        geometry_attributes->normals[i + 2] = normal.z;
+        normals[i] = normal.x;
+        normals[i + 1] = normal.y;
+        normals[i + 2] = normal.z;
     }
+}
 
-    return geometry_attributes;
+
+// Fills the x-slices x_begin <= x_idx < x_end of a density grid of n_chunks_y
+// chunks stacked along y, allocated by the caller. Every sample only depends
+// on its position, so slabs can be filled in any order and on any thread.
+void fillDensitySlab(
+    float* density,
+    MeshContext& mesh_context,
+    const DensityFunction& density_function,
+    int chunk_x, int chunk_y, int chunk_z,
+    uint n_vertices_x, uint n_vertices_y, uint n_vertices_z,
+    uint n_chunks_y,
+    uint x_begin, uint x_end
+) {
+    uint n_samples_y = n_vertices_y * n_chunks_y + 1;
+    uint n_samples_z = n_vertices_z + 1;
+
+    mesh_context.noise_z.resize(n_samples_z);
+    mesh_context.noise_scratch.resize(2 * n_samples_z);
+
+    for (uint z_idx = 0; z_idx < n_samples_z; z_idx++) {
+        mesh_context.noise_z[z_idx] = chunk_z + (float)z_idx / n_vertices_z;
+    }
+
+    float* row = density + x_begin * n_samples_y * n_samples_z;
+    for (uint x_idx = x_begin; x_idx < x_end; x_idx++) {
+        for (uint y_idx = 0; y_idx < n_samples_y; y_idx++) {
+            densityRow(
+                density_function,
+                chunk_x + (float)x_idx / n_vertices_x,
+                (chunk_y + (int)(y_idx / n_vertices_y)) + (float)(y_idx % n_vertices_y) / n_vertices_y,
+                mesh_context.noise_z.data(),
+                row,
+                n_samples_z,
+                mesh_context.noise_scratch.data()
+            );
+            row += n_samples_z;
+        }
+    }
 }
 
 
-GeometryAttributes* getGeometryAttributes(
+// Fills density with the samples of n_chunks_y chunks stacked along y.
+// Neighbouring chunks share their boundary plane. Returns the time spent.
+float fillDensityGrid(
+    vector<float>& density,
+    MeshContext& mesh_context,
+    const DensityFunction& density_function,
     int chunk_x, int chunk_y, int chunk_z,
     uint n_vertices_x, uint n_vertices_y, uint n_vertices_z,
-    float chunk_size_x, float chunk_size_y, float chunk_size_z,
-    float noise_frequency_x, float noise_frequency_y, float noise_frequency_z,
+    uint n_chunks_y
+) {
+    Clock::time_point start = Clock::now();
+
+    density.resize((n_vertices_x + 1) * (n_vertices_y * n_chunks_y + 1) * (n_vertices_z + 1));
+    fillDensitySlab(
+        density.data(),
+        mesh_context,
+        density_function,
+        chunk_x, chunk_y, chunk_z,
+        n_vertices_x, n_vertices_y, n_vertices_z,
+        n_chunks_y,
+        0, n_vertices_x + 1
+    );
+
+    return elapsedMs(start);
+}
+
+
+// Marks the bricks whose samples lie on both sides of threshold. The other
+// bricks only contain cubes of index 0 or 255, which produce no triangles.
+// Returns the number of active bricks.
+uint classifyBricks(
+    vector<uint8_t>& active_bricks,
+    const DensityGrid& grid,
+    uint n_vertices_x, uint n_vertices_y, uint n_vertices_z,
     float threshold
 ) {
-    GeometryConstructor* geometry_constructor = new GeometryConstructor();
+    uint n_bricks_x = (n_vertices_x + BRICK_SIZE - 1) / BRICK_SIZE;
+    uint n_bricks_y = (n_vertices_y + BRICK_SIZE - 1) / BRICK_SIZE;
+    uint n_bricks_z = (n_vertices_z + BRICK_SIZE - 1) / BRICK_SIZE;
+
+    active_bricks.assign(n_bricks_x * n_bricks_y * n_bricks_z, 0);
+    uint n_active = 0;
+
+    for (uint brick_x = 0; brick_x < n_bricks_x; brick_x++) {
+        for (uint brick_y = 0; brick_y < n_bricks_y; brick_y++) {
+            for (uint brick_z = 0; brick_z < n_bricks_z; brick_z++) {
+                uint x_end = min((brick_x + 1) * BRICK_SIZE, n_vertices_x);
+                uint y_end = min((brick_y + 1) * BRICK_SIZE, n_vertices_y);
+                uint z_end = min((brick_z + 1) * BRICK_SIZE, n_vertices_z);
+
+                bool below = false;
+                bool above = false;
+                for (uint x_idx = brick_x * BRICK_SIZE; x_idx <= x_end && !(below && above); x_idx++) {
+                    for (uint y_idx = brick_y * BRICK_SIZE; y_idx <= y_end; y_idx++) {
+                        for (uint z_idx = brick_z * BRICK_SIZE; z_idx <= z_end; z_idx++) {
+                            if (grid.at(x_idx, y_idx, z_idx) < threshold) below = true;
+                            else above = true;
+                        }
+                    }
+                }
+
+                if (below && above) {
+                    active_bricks[(brick_x * n_bricks_y + brick_y) * n_bricks_z + brick_z] = 1;
+                    n_active++;
+                }
+            }
+        }
+    }
+
+    return n_active;
+}
+
+
+// Bytes held by the context buffers
+size_t contextBytes(const MeshContext& mesh_context) {
+    const GeometryConstructor& geometry_constructor = mesh_context.geometry_constructor;
+
+    return (mesh_context.density.capacity() + mesh_context.noise_z.capacity() + mesh_context.noise_scratch.capacity()) * sizeof(float)
+        + mesh_context.active_bricks.capacity()
+        + (mesh_context.edge_cache.slices[0].capacity() + mesh_context.edge_cache.slices[1].capacity()) * sizeof(uint)
+        + (geometry_constructor.positions.capacity() + geometry_constructor.normals.capacity()) * sizeof(float)
+        + geometry_constructor.indices.capacity() * sizeof(uint);
+}
+
+
+// Clears the stats of the context before it meshes a new chunk
+MeshStats& beginStats(MeshContext& mesh_context) {
+    mesh_context.geometry_attributes.stats = MeshStats();
+    return mesh_context.geometry_attributes.stats;
+}
+
+
+GeometryAttributes* finishGeometryAttributes(MeshContext& mesh_context, uint cells_total, uint cells_skipped) {
+    GeometryConstructor& geometry_constructor = mesh_context.geometry_constructor;
+    GeometryAttributes& geometry_attributes = mesh_context.geometry_attributes;
+
+    geometry_attributes.positions = geometry_constructor.positions.data();
+    geometry_attributes.positions_size = geometry_constructor.positions.size();
+    geometry_attributes.normals = geometry_constructor.normals.data();
+    geometry_attributes.normals_size = geometry_constructor.normals.size();
+    geometry_attributes.indices = geometry_constructor.indices.data();
+    geometry_attributes.indices_size = geometry_constructor.indices.size();
+
+    MeshStats& stats = geometry_attributes.stats;
+    stats.cells_total = cells_total;
+    stats.cells_skipped = cells_skipped;
+    stats.n_vertices = geometry_constructor.positions.size() / 3;
+    stats.n_triangles = geometry_constructor.indices.size() / 3;
+
+    size_t buffer_bytes = contextBytes(mesh_context);
+    if (buffer_bytes > mesh_context.buffer_bytes) {
+        stats.bytes_allocated += buffer_bytes - mesh_context.buffer_bytes;
+    }
+    mesh_context.buffer_bytes = buffer_bytes;
+
+    return &geometry_attributes;
+}
+
+
+// Zero geometry, for chunks that cannot cross threshold
+GeometryAttributes* emptyGeometryAttributes(MeshContext& mesh_context, uint cells_total) {
+    mesh_context.geometry_constructor.positions.clear();
+    mesh_context.geometry_constructor.normals.clear();
+    mesh_context.geometry_constructor.indices.clear();
+
+    return finishGeometryAttributes(mesh_context, cells_total, cells_total);
+}
+
+
+// Whether the density bound of the chunk rules out any surface, before sampling
+bool isChunkUniform(const DensityFunction& density_function, int chunk_y, float threshold) {
+    float min_value, max_value;
+    densityBounds(density_function, chunk_y, chunk_y + 1, min_value, max_value);
+
+    return max_value < threshold || min_value >= threshold;
+}
+
+
+// Transition blocks. Along the faces whose neighbour is one level coarser the
+// chunk is meshed in blocks of 2x2x2 cubes. A block is polygonized from its
+// surface, where samples lying on a coarse face are only used at even lattice
+// points, the ones the coarse neighbour has. Both chunks then cut their shared
+// plane along the same segments, also where several coarse faces meet. Faces
+// are numbered -x, +x, -y, +y, -z, +z.
+
+// Whether a lattice point lies on a face meshed at the coarse resolution
+static inline bool isOnCoarseFace(uint8_t transition_faces, const uint* n_vertices, const uint* point) {
+    for (uint8_t face = 0; face < 6; face++) {
+        if (!(transition_faces & (1 << face))) continue;
+        if (point[face / 2] == ((face & 1) ? n_vertices[face / 2] : 0)) return true;
+    }
+    return false;
+}
+
+
+static inline bool isSamplePoint(uint8_t transition_faces, const uint* n_vertices, const uint* point) {
+    return !((point[0] | point[1] | point[2]) & 1) || !isOnCoarseFace(transition_faces, n_vertices, point);
+}
+
+
+// Whether the cube belongs to a transition block instead of being meshed alone
+bool isTransitionCube(uint8_t transition_faces, const uint* n_vertices, uint x_idx, uint y_idx, uint z_idx) {
+    uint cube[3] = { x_idx, y_idx, z_idx };
+
+    for (uint8_t face = 0; face < 6; face++) {
+        if (!(transition_faces & (1 << face))) continue;
+
+        uint axis = face / 2;
+        if ((face & 1) ? cube[axis] + 2 >= n_vertices[axis] : cube[axis] < 2) return true;
+    }
+    return false;
+}
+
+
+// Vertex on the axis aligned edge from lattice point p to lattice point q, with
+// p before q. Edges two cubes long only exist on coarse faces, and are placed
+// exactly as the coarse neighbour places them.
+uint getTransitionVertex(
+    MeshContext& mesh_context,
+    const DensityGrid& grid,
+    const uint* p, const uint* q,
+    const uint* n_vertices, const float* chunk_size, const float* chunk_pos,
+    float threshold
+) {
+    uint8_t axis = p[0] != q[0] ? 0 : (p[1] != q[1] ? 1 : 2);
+    bool coarse = q[axis] - p[axis] == 2;
+    uint64_t key = ((((uint64_t)p[0] * (n_vertices[1] + 1) + p[1]) * (n_vertices[2] + 1) + p[2]) * 3 + axis) * 2 + coarse;
+
+    auto cached = mesh_context.transition_vertices.find(key);
+    if (cached != mesh_context.transition_vertices.end()) {
+        return cached->second;
+    }
+
+    float value_0 = grid.at(p[0], p[1], p[2]);
+    float value_1 = grid.at(q[0], q[1], q[2]);
+    float mu = (threshold - value_0) / (value_1 - value_0);
+
+    vector<float>& positions = mesh_context.geometry_constructor.positions;
+    uint vertex_idx = positions.size() / 3;
+    for (uint8_t k = 0; k < 3; k++) {
+        if (coarse) {
+            float c = p[k] / 2;
+            if (k == axis) c += mu;
+            positions.push_back(c*(chunk_size[k] / (n_vertices[k] / 2)) + chunk_pos[k]);
+        } else {
+            float c = p[k];
+            if (k == axis) c += mu;
+            positions.push_back(c*(chunk_size[k] / n_vertices[k]) + chunk_pos[k]);
+        }
+    }
+
+    mesh_context.transition_vertices[key] = vertex_idx;
+    return vertex_idx;
+}
+
+
+// Polygonizes the 2x2x2 cubes starting at lattice point origin. Each face of
+// the block is split into polygons around its centre, at the edge midpoints
+// that are samples; on a coarse face that leaves the single coarse square.
+// Every polygon is cut like marching cubes cuts a cube face, separating the
+// below threshold corners, which is how triTable resolves ambiguous faces.
+// Polygons are walked counter-clockwise seen from outside the block, so the
+// cuts chain into oriented loops that are fanned into triangles.
+void emitTransitionBlock(
+    MeshContext& mesh_context,
+    const DensityGrid& grid,
+    uint8_t transition_faces,
+    const uint* origin,
+    const uint* n_vertices, const float* chunk_size, const float* chunk_pos,
+    float threshold
+) {
+    // Each edge of the block surface holds at most one vertex, starting one segment
+    const uint MAX_SEGMENTS = 48;
+    uint segments[MAX_SEGMENTS][2];
+    uint n_segments = 0;
+
+    for (uint8_t axis = 0; axis < 3; axis++) {
+        uint8_t axis_u = (axis + 1) % 3;
+        uint8_t axis_v = (axis + 2) % 3;
+
+        for (uint side = 0; side <= 2; side += 2) {
+            // Ring points 0-7, then the centre
+            uint points[9][3];
+            bool present[9];
+            bool below[9];
+            for (uint8_t point = 0; point < 9; point++) {
+                points[point][axis] = origin[axis] + side;
+                points[point][axis_u] = origin[axis_u] + (point < 8 ? blockFaceRing[point][0] : 1);
+                points[point][axis_v] = origin[axis_v] + (point < 8 ? blockFaceRing[point][1] : 1);
+
+                present[point] = isSamplePoint(transition_faces, n_vertices, points[point]);
+                below[point] = present[point] && grid.at(points[point][0], points[point][1], points[point][2]) < threshold;
+            }
+
+            uint8_t midpoints[4];
+            uint8_t n_midpoints = 0;
+            for (uint8_t point = 1; point < 8; point += 2) {
+                if (present[point]) midpoints[n_midpoints++] = point;
+            }
+
+            uint8_t polygons[4][9];
+            uint8_t polygon_sizes[4];
+            uint8_t n_polygons = 0;
+            if (!present[8] || n_midpoints < 2) {
+                polygon_sizes[0] = 0;
+                for (uint8_t point = 0; point < 8; point++) {
+                    if (present[point]) polygons[0][polygon_sizes[0]++] = point;
+                }
+                n_polygons = 1;
+            } else {
+                for (uint8_t i = 0; i < n_midpoints; i++) {
+                    uint8_t* polygon = polygons[n_polygons];
+                    uint8_t& size = polygon_sizes[n_polygons++];
+                    size = 0;
+                    polygon[size++] = 8;
+
+                    uint8_t end = midpoints[(i + 1) % n_midpoints];
+                    for (uint8_t point = midpoints[i]; ; point = (point + 1) % 8) {
+                        if (present[point]) polygon[size++] = point;
+                        if (point == end) break;
+                    }
+                }
+            }
+
+            for (uint8_t polygon = 0; polygon < n_polygons; polygon++) {
+                const uint8_t* corners = polygons[polygon];
+                uint8_t n_corners = polygon_sizes[polygon];
+
+                uint crossings[8];
+                bool entering[8];
+                uint n_crossings = 0;
+                for (uint8_t i = 0; i < n_corners; i++) {
+                    // The ring is counter-clockwise around +axis, reversed on the low side
+                    uint8_t a = corners[side ? i : (n_corners - i) % n_corners];
+                    uint8_t b = corners[side ? (i + 1) % n_corners : n_corners - 1 - i];
+                    if (below[a] == below[b]) continue;
+
+                    const uint* p = points[a];
+                    const uint* q = points[b];
+                    if (p[0] + p[1] + p[2] > q[0] + q[1] + q[2]) swap(p, q);
+
+                    entering[n_crossings] = below[b];
+                    crossings[n_crossings++] = getTransitionVertex(
+                        mesh_context, grid, p, q,
+                        n_vertices, chunk_size, chunk_pos, threshold
+                    );
+                }
+
+                for (uint i = 0; i < n_crossings; i++) {
+                    if (!entering[i]) continue;
+                    segments[n_segments][0] = crossings[i];
+                    segments[n_segments][1] = crossings[(i + 1) % n_crossings];
+                    n_segments++;
+                }
+            }
+        }
+    }
+
+    vector<uint>& indices = mesh_context.geometry_constructor.indices;
+
+    bool used[MAX_SEGMENTS] = {};
+    for (uint start = 0; start < n_segments; start++) {
+        if (used[start]) continue;
+
+        uint loop[MAX_SEGMENTS];
+        uint n_loop = 0;
+        for (uint segment = start; segment < n_segments && !used[segment]; ) {
+            used[segment] = true;
+            loop[n_loop++] = segments[segment][0];
+
+            uint next = segments[segment][1];
+            segment = n_segments;
+            for (uint s = 0; s < n_segments; s++) {
+                if (!used[s] && segments[s][0] == next) { segment = s; break; }
+            }
+        }
+
+        // Wound like triTable, facing the below threshold side
+        for (uint i = 1; i + 1 < n_loop; i++) {
+            indices.push_back(loop[0]);
+            indices.push_back(loop[i + 1]);
+            indices.push_back(loop[i]);
+        }
+    }
+}
+
+
+void emitTransitionBlocks(
+    MeshContext& mesh_context,
+    const DensityGrid& grid,
+    uint8_t transition_faces,
+    const uint* n_vertices, const float* chunk_size, const float* chunk_pos,
+    float threshold
+) {
+    mesh_context.transition_vertices.clear();
+
+    uint origin[3];
+    for (origin[0] = 0; origin[0] < n_vertices[0]; origin[0] += 2) {
+        for (origin[1] = 0; origin[1] < n_vertices[1]; origin[1] += 2) {
+            for (origin[2] = 0; origin[2] < n_vertices[2]; origin[2] += 2) {
+                if (!isTransitionCube(transition_faces, n_vertices, origin[0], origin[1], origin[2])) continue;
+
+                emitTransitionBlock(
+                    mesh_context, grid, transition_faces, origin,
+                    n_vertices, chunk_size, chunk_pos, threshold
+                );
+            }
+        }
+    }
+}
+
+
+GeometryAttributes* meshDensityGrid(
+    MeshContext& mesh_context,
+    const DensityGrid& grid,
+    int chunk_x, int chunk_y, int chunk_z,
+    uint n_vertices_x, uint n_vertices_y, uint n_vertices_z,
+    float chunk_size_x, float chunk_size_y, float chunk_size_z,
+    const DensityFunction& density_function,
+    float threshold,
+    uint8_t transition_faces
+) {
+    GeometryConstructor& geometry_constructor = mesh_context.geometry_constructor;
+    EdgeCache& edge_cache = mesh_context.edge_cache;
+    vector<uint8_t>& active_bricks = mesh_context.active_bricks;
+    MeshStats& stats = mesh_context.geometry_attributes.stats;
+
+    uint cells_total = n_vertices_x * n_vertices_y * n_vertices_z;
+    Clock::time_point start = Clock::now();
+    uint n_active = classifyBricks(active_bricks, grid, n_vertices_x, n_vertices_y, n_vertices_z, threshold);
+    stats.classification_ms = elapsedMs(start);
+
+    if (n_active == 0) {
+        return emptyGeometryAttributes(mesh_context, cells_total);
+    }
+
+    start = Clock::now();
+
+    geometry_constructor.positions.clear();
+    geometry_constructor.normals.clear();
+    geometry_constructor.indices.clear();
+    edge_cache.resize(n_vertices_y, n_vertices_z);
 
     float ratio_x = chunk_size_x / n_vertices_x;
     float ratio_y = chunk_size_y / n_vertices_y;
@@ -173,61 +605,569 @@ GeometryAttributes* getGeometryAttributes(
     float chunk_pos_y = chunk_y * chunk_size_y;
     float chunk_pos_z = chunk_z * chunk_size_z;
 
-    float*** noise_values = new float**[n_vertices_x + 1];
-    for (uint x_idx = 0; x_idx < n_vertices_x + 1; x_idx++) {
-        noise_values[x_idx] = new float*[n_vertices_y + 1];
-        for (uint y_idx = 0; y_idx < n_vertices_y + 1; y_idx++) {
-            noise_values[x_idx][y_idx] = new float[n_vertices_z + 1];
-            for (uint z_idx = 0; z_idx < n_vertices_z + 1; z_idx++) {
-                noise_values[x_idx][y_idx][z_idx] = noise(
-                    noise_frequency_x*(chunk_x + (float)x_idx / n_vertices_x),
-                    noise_frequency_y*(chunk_y + (float)y_idx / n_vertices_y),
-                    noise_frequency_z*(chunk_z + (float)z_idx / n_vertices_z)
-                );
-            }
-        }
-    }
+    uint n_bricks_y = (n_vertices_y + BRICK_SIZE - 1) / BRICK_SIZE;
+    uint n_bricks_z = (n_vertices_z + BRICK_SIZE - 1) / BRICK_SIZE;
+    uint cells_skipped = 0;
+
+    const uint n_vertices[3] = { n_vertices_x, n_vertices_y, n_vertices_z };
 
     for (uint x_idx = 0; x_idx < n_vertices_x; x_idx++) {
+        edge_cache.clearSlice(x_idx + 1);
+
         for (uint y_idx = 0; y_idx < n_vertices_y; y_idx++) {
-            for (uint z_idx = 0; z_idx < n_vertices_z; z_idx++) {
-                uint8_t cube_idx = getCubeIdx(noise_values, x_idx, y_idx, z_idx, threshold);
-
-                uint16_t edges = edgeTable[cube_idx];
-
-                CubeInfo* cube_info = getCubeInfo(
-                    noise_values,
-                    x_idx, y_idx, z_idx,
-                    edges,
-                    ratio_x, ratio_y, ratio_z,
-                    chunk_pos_x, chunk_pos_y, chunk_pos_z,
-                    threshold
-                );
-                
-                for (uint8_t i = 0; i < 16; i++) {
-                    int8_t val = triTable[16*cube_idx + i];
+            const uint8_t* brick_row = &active_bricks[((x_idx / BRICK_SIZE) * n_bricks_y + y_idx / BRICK_SIZE) * n_bricks_z];
+
+            for (uint brick_z = 0; brick_z < n_bricks_z; brick_z++) {
+                uint z_start = brick_z * BRICK_SIZE;
+                uint z_end = min(z_start + BRICK_SIZE, n_vertices_z);
 
-                    if (val == -1) { break; }
-                        
-                    geometry_constructor->indices.push_back(cube_info->indices[val] + geometry_constructor->positions.size() / 3);
+                if (!brick_row[brick_z]) {
+                    cells_skipped += z_end - z_start;
+                    continue;
                 }
-                geometry_constructor->positions.insert(geometry_constructor->positions.end(), cube_info->positions.begin(), cube_info->positions.end());
 
-                delete cube_info;
+                for (uint z_idx = z_start; z_idx < z_end; z_idx++) {
+                    if (transition_faces && isTransitionCube(transition_faces, n_vertices, x_idx, y_idx, z_idx)) { continue; }
+
+                    uint8_t cube_idx = getCubeIdx(grid, x_idx, y_idx, z_idx, threshold);
+
+                    if (edgeTable[cube_idx] == 0) { continue; }
+
+                    for (uint8_t i = 0; i < 16; i++) {
+                        int8_t val = triTable[16*cube_idx + i];
+
+                        if (val == -1) { break; }
+
+                        geometry_constructor.indices.push_back(getEdgeVertex(
+                            geometry_constructor,
+                            edge_cache,
+                            grid,
+                            x_idx, y_idx, z_idx,
+                            val,
+                            ratio_x, ratio_y, ratio_z,
+                            chunk_pos_x, chunk_pos_y, chunk_pos_z,
+                            threshold
+                        ));
+                    }
+                }
+            }
+        }
+    }
+
+    if (transition_faces) {
+        const float chunk_size[3] = { chunk_size_x, chunk_size_y, chunk_size_z };
+        const float chunk_pos[3] = { chunk_pos_x, chunk_pos_y, chunk_pos_z };
+        emitTransitionBlocks(mesh_context, grid, transition_faces, n_vertices, chunk_size, chunk_pos, threshold);
+    }
+    stats.vertex_emission_ms = elapsedMs(start);
+
+    start = Clock::now();
+    computeNormals(geometry_constructor, density_function, chunk_size_x, chunk_size_y, chunk_size_z);
+    stats.normals_ms = elapsedMs(start);
+
+    return finishGeometryAttributes(mesh_context, cells_total, cells_skipped);
+}
+
+
+GeometryAttributes* copyGeometryAttributes(const GeometryAttributes& source) {
+    Clock::time_point start = Clock::now();
+    GeometryAttributes* geometry_attributes = new GeometryAttributes();
+
+    geometry_attributes->positions_size = source.positions_size;
+    geometry_attributes->positions = new float[source.positions_size];
+    copy(source.positions, source.positions + source.positions_size, geometry_attributes->positions);
+
+    geometry_attributes->normals_size = source.normals_size;
+    geometry_attributes->normals = new float[source.normals_size];
+    copy(source.normals, source.normals + source.normals_size, geometry_attributes->normals);
+
+    geometry_attributes->indices_size = source.indices_size;
+    geometry_attributes->indices = new uint[source.indices_size];
+    copy(source.indices, source.indices + source.indices_size, geometry_attributes->indices);
+
+    geometry_attributes->stats = source.stats;
+    geometry_attributes->stats.bytes_allocated += sizeof(GeometryAttributes)
+        + (source.positions_size + source.normals_size) * sizeof(float)
+        + source.indices_size * sizeof(uint);
+    geometry_attributes->stats.copy_ms = elapsedMs(start);
+
+    return geometry_attributes;
+}
+
+
+MeshContext* createMeshContext() {
+    return new MeshContext();
+}
+
+
+void resetMeshContext(MeshContext* mesh_context) {
+    *mesh_context = MeshContext();
+}
+
+
+void deleteMeshContext(MeshContext* mesh_context) {
+    delete mesh_context;
+}
+
+
+GeometryAttributes* meshChunk(
+    MeshContext* mesh_context,
+    int chunk_x, int chunk_y, int chunk_z,
+    uint n_vertices_x, uint n_vertices_y, uint n_vertices_z,
+    float chunk_size_x, float chunk_size_y, float chunk_size_z,
+    const DensityFunction* density_function,
+    float threshold
+) {
+    MeshStats& stats = beginStats(*mesh_context);
+    if (isChunkUniform(*density_function, chunk_y, threshold)) {
+        return emptyGeometryAttributes(*mesh_context, n_vertices_x * n_vertices_y * n_vertices_z);
+    }
+
+    stats.noise_fill_ms = fillDensityGrid(
+        mesh_context->density,
+        *mesh_context,
+        *density_function,
+        chunk_x, chunk_y, chunk_z,
+        n_vertices_x, n_vertices_y, n_vertices_z,
+        1
+    );
+
+    DensityGrid grid = { mesh_context->density.data(), (n_vertices_y + 1) * (n_vertices_z + 1), n_vertices_z + 1 };
+
+    return meshDensityGrid(
+        *mesh_context,
+        grid,
+        chunk_x, chunk_y, chunk_z,
+        n_vertices_x, n_vertices_y, n_vertices_z,
+        chunk_size_x, chunk_size_y, chunk_size_z,
+        *density_function,
+        threshold,
+        0
+    );
+}
+
+
+GeometryAttributes* meshChunkLod(
+    MeshContext* mesh_context,
+    int chunk_x, int chunk_y, int chunk_z,
+    uint n_vertices_x, uint n_vertices_y, uint n_vertices_z,
+    float chunk_size_x, float chunk_size_y, float chunk_size_z,
+    uint lod, const uint* neighbour_lods,
+    const DensityFunction* density_function,
+    float threshold
+) {
+    n_vertices_x >>= lod;
+    n_vertices_y >>= lod;
+    n_vertices_z >>= lod;
+
+    uint8_t transition_faces = 0;
+    for (uint8_t face = 0; face < 6; face++) {
+        if (neighbour_lods[face] > lod) transition_faces |= 1 << face;
+    }
+
+    // Transition blocks span two cubes, and the coarse neighbour samples every other point
+    for (uint n_vertices : { n_vertices_x, n_vertices_y, n_vertices_z }) {
+        if (n_vertices == 0 || (transition_faces && n_vertices % 2 != 0)) return nullptr;
+    }
+
+    MeshStats& stats = beginStats(*mesh_context);
+    if (isChunkUniform(*density_function, chunk_y, threshold)) {
+        return emptyGeometryAttributes(*mesh_context, n_vertices_x * n_vertices_y * n_vertices_z);
+    }
+
+    stats.noise_fill_ms = fillDensityGrid(
+        mesh_context->density,
+        *mesh_context,
+        *density_function,
+        chunk_x, chunk_y, chunk_z,
+        n_vertices_x, n_vertices_y, n_vertices_z,
+        1
+    );
+
+    DensityGrid grid = { mesh_context->density.data(), (n_vertices_y + 1) * (n_vertices_z + 1), n_vertices_z + 1 };
+
+    return meshDensityGrid(
+        *mesh_context,
+        grid,
+        chunk_x, chunk_y, chunk_z,
+        n_vertices_x, n_vertices_y, n_vertices_z,
+        chunk_size_x, chunk_size_y, chunk_size_z,
+        *density_function,
+        threshold,
+        transition_faces
+    );
+}
+
+
+DensityCache* createDensityCache(uint budget_bytes) {
+    return new DensityCache(budget_bytes);
+}
+
+
+void clearDensityCache(DensityCache* density_cache) {
+    density_cache->clear();
+}
+
+
+void deleteDensityCache(DensityCache* density_cache) {
+    delete density_cache;
+}
+
+
+GeometryAttributes* meshChunkCached(
+    MeshContext* mesh_context,
+    DensityCache* density_cache,
+    int chunk_x, int chunk_y, int chunk_z,
+    uint n_vertices_x, uint n_vertices_y, uint n_vertices_z,
+    float chunk_size_x, float chunk_size_y, float chunk_size_z,
+    const DensityFunction* density_function,
+    float threshold
+) {
+    MeshStats& stats = beginStats(*mesh_context);
+    if (isChunkUniform(*density_function, chunk_y, threshold)) {
+        return emptyGeometryAttributes(*mesh_context, n_vertices_x * n_vertices_y * n_vertices_z);
+    }
+
+    DensityKey key = makeDensityKey(*density_function, chunk_x, chunk_y, chunk_z, n_vertices_x, n_vertices_y, n_vertices_z);
+    DensityCache::Field field = density_cache->find(key);
+
+    if (!field) {
+        shared_ptr<vector<float>> density = make_shared<vector<float>>();
+        stats.noise_fill_ms = fillDensityGrid(
+            *density,
+            *mesh_context,
+            *density_function,
+            chunk_x, chunk_y, chunk_z,
+            n_vertices_x, n_vertices_y, n_vertices_z,
+            1
+        );
+        stats.bytes_allocated += density->capacity() * sizeof(float);
+        field = density;
+        density_cache->insert(key, field);
+    }
+
+    DensityGrid grid = { field->data(), (n_vertices_y + 1) * (n_vertices_z + 1), n_vertices_z + 1 };
+
+    return meshDensityGrid(
+        *mesh_context,
+        grid,
+        chunk_x, chunk_y, chunk_z,
+        n_vertices_x, n_vertices_y, n_vertices_z,
+        chunk_size_x, chunk_size_y, chunk_size_z,
+        *density_function,
+        threshold,
+        0
+    );
+}
+
+
+GeometryAttributes* getGeometryAttributes(
+    int chunk_x, int chunk_y, int chunk_z,
+    uint n_vertices_x, uint n_vertices_y, uint n_vertices_z,
+    float chunk_size_x, float chunk_size_y, float chunk_size_z,
+    const DensityFunction* density_function,
+    float threshold
+) {
+    static thread_local MeshContext mesh_context;
+
+    return copyGeometryAttributes(*meshChunk(
+        &mesh_context,
+        chunk_x, chunk_y, chunk_z,
+        n_vertices_x, n_vertices_y, n_vertices_z,
+        chunk_size_x, chunk_size_y, chunk_size_z,
+        density_function,
+        threshold
+    ));
+}
+
+
+void releaseGeometry(GeometryAttributes* geometry_attributes) {
+    delete[] geometry_attributes->positions;
+    delete[] geometry_attributes->normals;
+    delete[] geometry_attributes->indices;
+    delete geometry_attributes;
+}
+
+
+// One run of vertically adjacent chunks of a batch, sampled as a single grid.
+// The grid is filled in x-slabs that idle workers can take, and the slab that
+// finishes last queues the meshing of the chunks.
+struct DensityColumn {
+    vector<uint> result_indices;
+    vector<float> density;
+    uint stride_x;
+    uint stride_y;
+
+    uint n_slabs;
+    vector<float> slab_fill_ms;
+    atomic<uint> n_slabs_left;
+};
+
+
+void finishChunk(ChunkBatch* chunk_batch, uint result_idx) {
+    lock_guard<mutex> lock(chunk_batch->lock);
+    chunk_batch->finished.push_back(result_idx);
+    chunk_batch->n_running--;
+    chunk_batch->done.notify_all();
+}
+
+
+// Accounts for chunks of a cancelled batch that are dropped without being meshed
+void dropChunks(ChunkBatch* chunk_batch, uint n_chunks) {
+    lock_guard<mutex> lock(chunk_batch->lock);
+    chunk_batch->n_running -= n_chunks;
+    chunk_batch->done.notify_all();
+}
+
+
+// Each pool worker meshes into its own context
+MeshContext& getWorkerMeshContext() {
+    static thread_local MeshContext mesh_context;
+    return mesh_context;
+}
+
+
+void meshColumn(ChunkBatch* chunk_batch, shared_ptr<DensityColumn> column, uint worker) {
+    uint n_chunks = column->result_indices.size();
+    if (chunk_batch->cancelled) {
+        dropChunks(chunk_batch, n_chunks);
+        return;
+    }
+
+    // The column is sampled once, its cost is split evenly between its chunks
+    float noise_fill_ms = 0.0f;
+    for (float slab_fill_ms : column->slab_fill_ms) {
+        noise_fill_ms += slab_fill_ms;
+    }
+    noise_fill_ms /= n_chunks;
+    uint column_bytes = column->density.capacity() * sizeof(float) / n_chunks;
+
+    // Each chunk is meshed as its own task so that idle workers can steal them
+    for (uint chunk_idx = 0; chunk_idx < n_chunks; chunk_idx++) {
+        uint result_idx = column->result_indices[chunk_idx];
+        getChunkPool().submit([chunk_batch, column, chunk_idx, result_idx, noise_fill_ms, column_bytes](uint) {
+            if (chunk_batch->cancelled) {
+                dropChunks(chunk_batch, 1);
+                return;
             }
+
+            ChunkResult& result = chunk_batch->results[result_idx];
+            MeshContext& mesh_context = getWorkerMeshContext();
+
+            MeshStats& stats = beginStats(mesh_context);
+            stats.noise_fill_ms = noise_fill_ms;
+            stats.bytes_allocated = column_bytes;
+
+            DensityGrid grid = {
+                column->density.data() + chunk_idx * chunk_batch->n_vertices_y * column->stride_y,
+                column->stride_x,
+                column->stride_y
+            };
+
+            result.geometry_attributes = copyGeometryAttributes(*meshDensityGrid(
+                mesh_context,
+                grid,
+                result.chunk_x, result.chunk_y, result.chunk_z,
+                chunk_batch->n_vertices_x, chunk_batch->n_vertices_y, chunk_batch->n_vertices_z,
+                chunk_batch->chunk_size_x, chunk_batch->chunk_size_y, chunk_batch->chunk_size_z,
+                *chunk_batch->density_function,
+                chunk_batch->threshold,
+                0
+            ));
+
+            finishChunk(chunk_batch, result_idx);
+        }, worker);
+    }
+}
+
+
+void fillColumnSlab(ChunkBatch* chunk_batch, shared_ptr<DensityColumn> column, uint slab, uint worker) {
+    if (!chunk_batch->cancelled) {
+        Clock::time_point start = Clock::now();
+
+        const ChunkResult& bottom = chunk_batch->results[column->result_indices[0]];
+        uint n_samples_x = chunk_batch->n_vertices_x + 1;
+        fillDensitySlab(
+            column->density.data(),
+            getWorkerMeshContext(),
+            *chunk_batch->density_function,
+            bottom.chunk_x, bottom.chunk_y, bottom.chunk_z,
+            chunk_batch->n_vertices_x, chunk_batch->n_vertices_y, chunk_batch->n_vertices_z,
+            column->result_indices.size(),
+            slab * n_samples_x / column->n_slabs, (slab + 1) * n_samples_x / column->n_slabs
+        );
+
+        column->slab_fill_ms[slab] = elapsedMs(start);
+    }
+
+    if (column->n_slabs_left.fetch_sub(1) == 1) {
+        meshColumn(chunk_batch, column, worker);
+    }
+}
+
+
+void scheduleColumn(ChunkBatch* chunk_batch, vector<uint> result_indices, uint n_slabs, uint worker) {
+    if (chunk_batch->cancelled) {
+        dropChunks(chunk_batch, result_indices.size());
+        return;
+    }
+
+    shared_ptr<DensityColumn> column = make_shared<DensityColumn>();
+    column->stride_y = chunk_batch->n_vertices_z + 1;
+    column->stride_x = (chunk_batch->n_vertices_y * result_indices.size() + 1) * column->stride_y;
+    column->density.resize((chunk_batch->n_vertices_x + 1) * column->stride_x);
+    column->result_indices = move(result_indices);
+
+    column->n_slabs = min(n_slabs, chunk_batch->n_vertices_x + 1);
+    column->slab_fill_ms.assign(column->n_slabs, 0.0f);
+    column->n_slabs_left = column->n_slabs;
+
+    for (uint slab = 1; slab < column->n_slabs; slab++) {
+        getChunkPool().submit([chunk_batch, column, slab](uint slab_worker) {
+            fillColumnSlab(chunk_batch, column, slab, slab_worker);
+        });
+    }
+    fillColumnSlab(chunk_batch, column, 0, worker);
+}
+
+
+ChunkBatch* startChunkBatch(
+    const int* chunk_coords, uint n_chunks,
+    uint n_vertices_x, uint n_vertices_y, uint n_vertices_z,
+    float chunk_size_x, float chunk_size_y, float chunk_size_z,
+    const DensityFunction* density_function,
+    float threshold
+) {
+    ChunkBatch* chunk_batch = new ChunkBatch();
+    chunk_batch->n_vertices_x = n_vertices_x;
+    chunk_batch->n_vertices_y = n_vertices_y;
+    chunk_batch->n_vertices_z = n_vertices_z;
+    chunk_batch->chunk_size_x = chunk_size_x;
+    chunk_batch->chunk_size_y = chunk_size_y;
+    chunk_batch->chunk_size_z = chunk_size_z;
+    chunk_batch->density_function = density_function;
+    chunk_batch->threshold = threshold;
+    chunk_batch->n_running = n_chunks;
+    chunk_batch->n_undelivered = n_chunks;
+
+    chunk_batch->results.resize(n_chunks);
+    vector<uint> order;
+    for (uint i = 0; i < n_chunks; i++) {
+        chunk_batch->results[i] = { chunk_coords[3*i], chunk_coords[3*i + 1], chunk_coords[3*i + 2], nullptr };
+
+        // Chunks that cannot cross threshold are done before any sampling
+        if (isChunkUniform(*density_function, chunk_batch->results[i].chunk_y, threshold)) {
+            beginStats(getWorkerMeshContext());
+            chunk_batch->results[i].geometry_attributes = copyGeometryAttributes(
+                *emptyGeometryAttributes(getWorkerMeshContext(), n_vertices_x * n_vertices_y * n_vertices_z)
+            );
+            chunk_batch->finished.push_back(i);
+            chunk_batch->n_running--;
+            continue;
         }
+
+        order.push_back(i);
     }
 
-    GeometryAttributes* geometry_attributes = getGeometryAttributesFromConstructor(geometry_constructor);
+    // Group the chunks into runs of consecutive y inside the same column
+    sort(order.begin(), order.end(), [chunk_batch](uint a, uint b) {
+        const ChunkResult& chunk_a = chunk_batch->results[a];
+        const ChunkResult& chunk_b = chunk_batch->results[b];
+        if (chunk_a.chunk_x != chunk_b.chunk_x) return chunk_a.chunk_x < chunk_b.chunk_x;
+        if (chunk_a.chunk_z != chunk_b.chunk_z) return chunk_a.chunk_z < chunk_b.chunk_z;
+        return chunk_a.chunk_y < chunk_b.chunk_y;
+    });
 
-    delete geometry_constructor;
-    for (uint x_idx = 0; x_idx < n_vertices_x + 1; x_idx++) {
-        for (uint y_idx = 0; y_idx < n_vertices_y + 1; y_idx++) {
-            delete[] noise_values[x_idx][y_idx];
+    vector<vector<uint>> runs;
+    uint run_start = 0;
+    for (uint i = 1; i <= order.size(); i++) {
+        if (i < order.size()) {
+            const ChunkResult& previous = chunk_batch->results[order[i - 1]];
+            const ChunkResult& current = chunk_batch->results[order[i]];
+            if (current.chunk_x == previous.chunk_x && current.chunk_z == previous.chunk_z && current.chunk_y == previous.chunk_y + 1) {
+                continue;
+            }
         }
-        delete[] noise_values[x_idx];
+
+        runs.emplace_back(order.begin() + run_start, order.begin() + i);
+        run_start = i;
     }
-    delete[] noise_values;
 
-    return geometry_attributes;
-}
\ No newline at end of file
+    // Noise dominates the cost of a chunk. With fewer columns than workers,
+    // each column is sampled in several slabs so that every worker takes part.
+    uint n_workers = getChunkPool().size();
+    uint n_slabs = runs.empty() ? 1 : (n_workers + runs.size() - 1) / runs.size();
+
+    for (vector<uint>& result_indices : runs) {
+        getChunkPool().submit([chunk_batch, result_indices, n_slabs](uint worker) {
+            scheduleColumn(chunk_batch, result_indices, n_slabs, worker);
+        });
+    }
+
+    return chunk_batch;
+}
+
+
+// Blocks until ready() holds. A pool without threads runs its queued tasks
+// here instead, one at a time.
+template <typename Ready>
+void waitForBatch(ChunkBatch* chunk_batch, unique_lock<mutex>& lock, Ready ready) {
+    WorkStealingPool& pool = getChunkPool();
+    if (pool.hasThreads()) {
+        chunk_batch->done.wait(lock, ready);
+        return;
+    }
+
+    while (!ready()) {
+        lock.unlock();
+        pool.runQueued();
+        lock.lock();
+    }
+}
+
+
+ChunkResult* pollChunkBatch(ChunkBatch* chunk_batch) {
+    // Without threads, each poll advances the batch by one task
+    if (!getChunkPool().hasThreads()) {
+        getChunkPool().runQueued();
+    }
+
+    lock_guard<mutex> lock(chunk_batch->lock);
+    if (chunk_batch->finished.empty()) {
+        return nullptr;
+    }
+
+    uint result_idx = chunk_batch->finished.front();
+    chunk_batch->finished.pop_front();
+    chunk_batch->n_undelivered--;
+    return &chunk_batch->results[result_idx];
+}
+
+
+ChunkResult* waitChunkBatch(ChunkBatch* chunk_batch) {
+    unique_lock<mutex> lock(chunk_batch->lock);
+    if (chunk_batch->n_undelivered == 0) {
+        return nullptr;
+    }
+    waitForBatch(chunk_batch, lock, [chunk_batch]() { return !chunk_batch->finished.empty(); });
+
+    uint result_idx = chunk_batch->finished.front();
+    chunk_batch->finished.pop_front();
+    chunk_batch->n_undelivered--;
+    return &chunk_batch->results[result_idx];
+}
+
+
+void deleteChunkBatch(ChunkBatch* chunk_batch) {
+    chunk_batch->cancelled = true;
+    {
+        unique_lock<mutex> lock(chunk_batch->lock);
+        waitForBatch(chunk_batch, lock, [chunk_batch]() { return chunk_batch->n_running == 0; });
+    }
+
+    // Delivered results belong to the caller, the rest are still queued
+    for (uint result_idx : chunk_batch->finished) {
+        releaseGeometry(chunk_batch->results[result_idx].geometry_attributes);
+    }
+    delete chunk_batch;
+}
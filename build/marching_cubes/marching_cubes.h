@@ -1,12 +1,17 @@
-#include <list>
+#include <vector>
 #include <iostream>
 #include <cmath>
+#include <climits>
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
 
 #include "tables.h"
 #include "noise.cpp"
-
-
-const float EPSILON = 0.00001f;
+#include "noise_simd.cpp"
+#include "density.cpp"
+#include "density_cache.cpp"
+#include "scheduler.cpp"
 
 
 using namespace std;
@@ -14,15 +19,71 @@ using namespace std;
 typedef unsigned int uint;
 
 
-struct CubeInfo {
-    list<float> positions {};
-    uint indices[12];
-};
+const uint NO_VERTEX = UINT_MAX;
+
+// Edge length, in cubes, of the bricks classified before triangulation
+const uint BRICK_SIZE = 4;
 
 
 struct GeometryConstructor {
-    list<float> positions {};
-    list<uint> indices {};
+    vector<float> positions {};
+    vector<float> normals {};
+    vector<uint> indices {};
+};
+
+
+// Density samples laid out flat, z fastest. A view into a taller column grid
+// only needs an offset start pointer and the column strides.
+struct DensityGrid {
+    const float* values;
+    uint stride_x;
+    uint stride_y;
+
+    float at(uint x_idx, uint y_idx, uint z_idx) const {
+        return values[x_idx * stride_x + y_idx * stride_y + z_idx];
+    }
+};
+
+
+// Vertex index of every edge crossing in the two x-slices currently being
+// meshed. Each lattice point owns its +x, +y and +z edges.
+struct EdgeCache {
+    uint size_y = 0;
+    uint size_z = 0;
+    vector<uint> slices[2];
+
+    void resize(uint n_vertices_y, uint n_vertices_z) {
+        size_y = n_vertices_y + 1;
+        size_z = n_vertices_z + 1;
+        slices[0].assign(size_y * size_z * 3, NO_VERTEX);
+        slices[1].assign(size_y * size_z * 3, NO_VERTEX);
+    }
+
+    uint& at(uint x_idx, uint y_idx, uint z_idx, uint8_t axis) {
+        return slices[x_idx & 1][(y_idx * size_z + z_idx) * 3 + axis];
+    }
+
+    void clearSlice(uint x_idx) {
+        fill(slices[x_idx & 1].begin(), slices[x_idx & 1].end(), NO_VERTEX);
+    }
+};
+
+
+// Counters of the call that produced a mesh. Timings are in milliseconds.
+// bytes_allocated counts the buffers the call allocated or grew, so it drops
+// to the size of the output copy, if any, once a context is warm.
+struct MeshStats {
+    uint cells_total;
+    uint cells_skipped; // cubes culled without being triangulated
+    uint n_vertices;
+    uint n_triangles;
+    uint bytes_allocated;
+
+    float noise_fill_ms;
+    float classification_ms;
+    float vertex_emission_ms;
+    float normals_ms;
+    float copy_ms;
 };
 
 
@@ -35,6 +96,52 @@ struct GeometryAttributes {
 
     uint* indices;
     uint indices_size;
+
+    MeshStats stats;
+};
+
+
+// Scratch memory reused from one chunk to the next. Buffers grow to the largest
+// chunk seen and are only given back by resetMeshContext. geometry_attributes
+// points into the buffers and stays valid until the context is used again.
+struct MeshContext {
+    vector<float> density {};
+    vector<float> noise_z {};
+    vector<float> noise_scratch {};
+    vector<uint8_t> active_bricks {};
+    EdgeCache edge_cache {};
+    unordered_map<uint64_t, uint> transition_vertices {};
+    GeometryConstructor geometry_constructor {};
+    GeometryAttributes geometry_attributes {};
+    size_t buffer_bytes = 0; // capacity of the buffers when the last mesh was finished
+};
+
+
+struct ChunkResult {
+    int chunk_x;
+    int chunk_y;
+    int chunk_z;
+    GeometryAttributes* geometry_attributes;
+};
+
+
+// Chunks meshed in the background by the chunk pool. Finished chunks are
+// queued in completion order until pollChunkBatch / waitChunkBatch hands them out.
+struct ChunkBatch {
+    uint n_vertices_x, n_vertices_y, n_vertices_z;
+    float chunk_size_x, chunk_size_y, chunk_size_z;
+    const DensityFunction* density_function;
+    float threshold;
+
+    vector<ChunkResult> results;
+
+    mutex lock;
+    condition_variable done;
+    deque<uint> finished;
+    uint n_running;
+    uint n_undelivered;
+
+    atomic<bool> cancelled {false}; // set by deleteChunkBatch, checked before each task starts
 };
 
 
@@ -46,11 +153,105 @@ struct float3 {
 
 
 extern "C" {
+    DensityFunction* createDensityFunction(
+        uint seed, uint n_octaves,
+        float frequency, float persistence, float lacunarity,
+        float surface_level, float surface_transition_height,
+        float floor_level, float floor_transition_height
+    );
+
+    void deleteDensityFunction(DensityFunction* density_function);
+
+    MeshContext* createMeshContext();
+
+    // Frees the context buffers, keeping the context usable
+    void resetMeshContext(MeshContext* mesh_context);
+
+    void deleteMeshContext(MeshContext* mesh_context);
+
+    // Meshes a chunk into the context buffers. The returned attributes are owned
+    // by the context and are overwritten by its next call. A typed array view of
+    // them in JS is only valid until that call, or until the wasm memory grows,
+    // which detaches every view, so the JS wrapper copies them out.
+    GeometryAttributes* meshChunk(
+        MeshContext* mesh_context,
+        int chunk_x, int chunk_y, int chunk_z,
+        uint n_vertices_x, uint n_vertices_y, uint n_vertices_z,
+        float chunk_size_x, float chunk_size_y, float chunk_size_z,
+        const DensityFunction* density_function,
+        float threshold
+    );
+
+    // Meshes a chunk at level of detail lod, sampled at n_vertices >> lod per
+    // axis. neighbour_lods holds the lod of the -x, +x, -y, +y, -z, +z
+    // neighbours. Along faces whose neighbour is one level coarser, the two
+    // outermost layers of cubes are meshed as transition blocks that match the
+    // coarse neighbour's surface, so the two chunks join without cracks, also
+    // along edges and corners shared by several coarser neighbours. Neighbours
+    // must be at most one level apart.
+    // n_vertices >> lod must be at least 1 per axis, and even as soon as a
+    // neighbour is coarser. Returns null otherwise.
+    GeometryAttributes* meshChunkLod(
+        MeshContext* mesh_context,
+        int chunk_x, int chunk_y, int chunk_z,
+        uint n_vertices_x, uint n_vertices_y, uint n_vertices_z,
+        float chunk_size_x, float chunk_size_y, float chunk_size_z,
+        uint lod, const uint* neighbour_lods,
+        const DensityFunction* density_function,
+        float threshold
+    );
+
+    // Keeps the density grids of up to budget_bytes of chunks, least recently
+    // used first out. Safe to share between threads.
+    DensityCache* createDensityCache(uint budget_bytes);
+
+    void clearDensityCache(DensityCache* density_cache);
+
+    void deleteDensityCache(DensityCache* density_cache);
+
+    // Same as meshChunk, reusing the chunk's density grid from the cache when
+    // it was sampled with the same density function parameters and storing it
+    // otherwise. A threshold change then only reruns the triangulation.
+    GeometryAttributes* meshChunkCached(
+        MeshContext* mesh_context,
+        DensityCache* density_cache,
+        int chunk_x, int chunk_y, int chunk_z,
+        uint n_vertices_x, uint n_vertices_y, uint n_vertices_z,
+        float chunk_size_x, float chunk_size_y, float chunk_size_z,
+        const DensityFunction* density_function,
+        float threshold
+    );
+
+    // Same as meshChunk, returning a copy owned by the caller. Release it with releaseGeometry.
     GeometryAttributes* getGeometryAttributes(
         int chunk_x, int chunk_y, int chunk_z,
         uint n_vertices_x, uint n_vertices_y, uint n_vertices_z,
         float chunk_size_x, float chunk_size_y, float chunk_size_z,
-        float noise_frequency_x, float noise_frequency_y, float noise_frequency_z,
+        const DensityFunction* density_function,
+        float threshold
+    );
+
+    void releaseGeometry(GeometryAttributes* geometry_attributes);
+
+    // chunk_coords holds n_chunks (x, y, z) triplets. The density function must
+    // outlive the batch, and the caller releases the geometry of delivered results.
+    // Built without threads, the chunks are meshed inside pollChunkBatch, one
+    // task per call, and waitChunkBatch.
+    ChunkBatch* startChunkBatch(
+        const int* chunk_coords, uint n_chunks,
+        uint n_vertices_x, uint n_vertices_y, uint n_vertices_z,
+        float chunk_size_x, float chunk_size_y, float chunk_size_z,
+        const DensityFunction* density_function,
         float threshold
     );
+
+    // Next finished chunk, or null if none is ready yet
+    ChunkResult* pollChunkBatch(ChunkBatch* chunk_batch);
+
+    // Next finished chunk, blocking until one is ready. Null once every chunk was delivered.
+    ChunkResult* waitChunkBatch(ChunkBatch* chunk_batch);
+
+    // Cancels the chunks not started yet, waits for the ones being meshed and
+    // releases the geometry of every finished result that was not delivered.
+    void deleteChunkBatch(ChunkBatch* chunk_batch);
 }
\ No newline at end of file
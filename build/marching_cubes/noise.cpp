@@ -1,7 +1,5 @@
 #include <cstdint>
-
-
-float noise(float x, float y, float z);
+#include <string>
 
 
 static inline int32_t fastfloor(float fp) {
@@ -10,7 +8,7 @@ static inline int32_t fastfloor(float fp) {
 }
 
 
-static const uint8_t perm[256] = {
+static const uint8_t default_perm[256] = {
     151, 160, 137, 91, 90, 15,
     131, 13, 201, 95, 96, 53, 194, 233, 7, 225, 140, 36, 103, 30, 69, 142, 8, 99, 37, 240, 21, 10, 23,
     190, 6, 148, 247, 120, 234, 75, 0, 26, 197, 62, 94, 252, 219, 203, 117, 35, 11, 32, 57, 177, 33,
@@ -27,20 +25,129 @@ static const uint8_t perm[256] = {
 };
 
 
-static inline uint8_t _hash(int32_t i) {
+// Simplex noise over a 256 entry permutation table, with the gradients of the
+// simplex-noise package. Every function defaults to the classic table, seeded
+// tables come from fillPermutation.
+float noise(float x, float y, float z, const uint8_t* perm = default_perm);
+float noise(float x, float y, float z, float& dx, float& dy, float& dz, const uint8_t* perm = default_perm);
+
+
+// Mash of the alea package: folds the characters of data into the state n and
+// returns it scaled to [0, 1). Done in doubles, like the JS it reproduces.
+static double mash(double& n, const std::string& data) {
+    for (char character : data) {
+        n += static_cast<uint8_t>(character);
+        double h = 0.02519603282416938 * n;
+        n = static_cast<uint32_t>(h);
+        h -= n;
+        h *= n;
+        n = static_cast<uint32_t>(h);
+        h -= n;
+        n += h * 4294967296.0; // 2^32
+    }
+    return static_cast<uint32_t>(static_cast<uint64_t>(n)) * 2.3283064365386963e-10; // 2^-32
+}
+
+
+// Generator returned by Alea(seed) in the alea package
+struct Alea {
+    double s0, s1, s2, c;
+
+    explicit Alea(uint32_t seed) {
+        double n = 0xefc8249d;
+        s0 = mash(n, " ");
+        s1 = mash(n, " ");
+        s2 = mash(n, " ");
+
+        std::string seed_string = std::to_string(seed);
+        s0 -= mash(n, seed_string);
+        if (s0 < 0) s0 += 1;
+        s1 -= mash(n, seed_string);
+        if (s1 < 0) s1 += 1;
+        s2 -= mash(n, seed_string);
+        if (s2 < 0) s2 += 1;
+
+        c = 1;
+    }
+
+    double next() {
+        double t = 2091639 * s0 + c * 2.3283064365386963e-10; // 2^-32
+        s0 = s1;
+        s1 = s2;
+        c = static_cast<int32_t>(t);
+        return s2 = t - c;
+    }
+};
+
+
+// Permutation of createNoise3D(Alea(seed)) in the simplex-noise package, so a
+// seeded table reproduces the noise of scripts/marching_cubes/noise.js
+void fillPermutation(uint8_t* perm, uint32_t seed) {
+    for (int i = 0; i < 256; i++) {
+        perm[i] = i;
+    }
+
+    Alea random(seed);
+    for (int i = 0; i < 255; i++) {
+        int j = i + static_cast<int32_t>(random.next() * (256 - i));
+        uint8_t tmp = perm[i];
+        perm[i] = perm[j];
+        perm[j] = tmp;
+    }
+}
+
+
+static inline uint8_t _hash(const uint8_t* perm, int32_t i) {
     return perm[static_cast<uint8_t>(i)];
 }
 
 
+// Dot product with one of the 12 gradients of the simplex-noise package,
+// (+-1, +-1, 0), (+-1, 0, +-1) and (0, +-1, +-1), picked by _hash % 12
 static float grad(int32_t _hash, float x, float y, float z) {
-    int h = _hash & 15;     // Convert low 4 bits of _hash code into 12 simple
-    float u = h < 8 ? x : y; // gradient directions, and compute dot product.
-    float v = h < 4 ? y : h == 12 || h == 14 ? x : z; // Fix repeats at h = 12 to 15
+    int h = _hash % 12;
+    float u = h < 8 ? x : y;
+    float v = h < 4 ? y : z;
     return ((h & 1) ? -u : u) + ((h & 2) ? -v : v);
 }
 
 
-float noise(float x, float y, float z) {
+// Gradient vector matching the dot product computed by grad()
+static void gradVector(int32_t _hash, float& gx, float& gy, float& gz) {
+    int h = _hash % 12;
+    float su = (h & 1) ? -1.0f : 1.0f;
+    float sv = (h & 2) ? -1.0f : 1.0f;
+    gx = 0.0f; gy = 0.0f; gz = 0.0f;
+    if (h < 8) gx = su; else gy = su;
+    if (h < 4) gy = sv; else gz = sv;
+}
+
+
+// Contribution of one simplex corner, accumulating its analytic derivative:
+// d/dp (t^4 * g.p) = t^4 * g - 8 * t^3 * (g.p) * p
+static float cornerContribution(int32_t _hash, float x, float y, float z, float& dx, float& dy, float& dz) {
+    float t = 0.6f - x*x - y*y - z*z;
+    if (t < 0) {
+        return 0.0f;
+    }
+
+    float gx, gy, gz;
+    gradVector(_hash, gx, gy, gz);
+    float g_dot = grad(_hash, x, y, z);
+
+    float t2 = t * t;
+    float t4 = t2 * t2;
+    float k = 8.0f * t2 * t * g_dot;
+
+    dx += t4 * gx - k * x;
+    dy += t4 * gy - k * y;
+    dz += t4 * gz - k * z;
+
+    return t4 * g_dot;
+}
+
+
+float noise(float x, float y, float z, const uint8_t* perm) {
     float n0, n1, n2, n3; // Noise contributions from the four corners
 
     // Skewing/Unskewing factors for 3D
@@ -97,10 +204,10 @@ float noise(float x, float y, float z) {
     float z3 = z0 - 1.0f + 3.0f * G3;
 
     // Work out the _hashed gradient indices of the four simplex corners
-    int gi0 = _hash(i + _hash(j + _hash(k)));
-    int gi1 = _hash(i + i1 + _hash(j + j1 + _hash(k + k1)));
-    int gi2 = _hash(i + i2 + _hash(j + j2 + _hash(k + k2)));
-    int gi3 = _hash(i + 1 + _hash(j + 1 + _hash(k + 1)));
+    int gi0 = _hash(perm, i + _hash(perm, j + _hash(perm, k)));
+    int gi1 = _hash(perm, i + i1 + _hash(perm, j + j1 + _hash(perm, k + k1)));
+    int gi2 = _hash(perm, i + i2 + _hash(perm, j + j2 + _hash(perm, k + k2)));
+    int gi3 = _hash(perm, i + 1 + _hash(perm, j + 1 + _hash(perm, k + 1)));
 
     // Calculate the contribution from the four corners
     float t0 = 0.6f - x0*x0 - y0*y0 - z0*z0;
@@ -134,4 +241,64 @@ float noise(float x, float y, float z) {
     // Add contributions from each corner to get the final noise value.
     // The result is scaled to stay just inside [-1,1]
     return 32.0f*(n0 + n1 + n2 + n3);
-}
\ No newline at end of file
+}
+
+
+// Same as noise(x, y, z), also writing the analytic gradient in (dx, dy, dz)
+float noise(float x, float y, float z, float& dx, float& dy, float& dz, const uint8_t* perm) {
+    static const float F3 = 1.0f / 3.0f;
+    static const float G3 = 1.0f / 6.0f;
+
+    float s = (x + y + z) * F3;
+    int i = fastfloor(x + s);
+    int j = fastfloor(y + s);
+    int k = fastfloor(z + s);
+    float t = (i + j + k) * G3;
+    float x0 = x - (i - t);
+    float y0 = y - (j - t);
+    float z0 = z - (k - t);
+
+    int i1, j1, k1;
+    int i2, j2, k2;
+    if (x0 >= y0) {
+        if (y0 >= z0) {
+            i1 = 1; j1 = 0; k1 = 0; i2 = 1; j2 = 1; k2 = 0;
+        } else if (x0 >= z0) {
+            i1 = 1; j1 = 0; k1 = 0; i2 = 1; j2 = 0; k2 = 1;
+        } else {
+            i1 = 0; j1 = 0; k1 = 1; i2 = 1; j2 = 0; k2 = 1;
+        }
+    } else {
+        if (y0 < z0) {
+            i1 = 0; j1 = 0; k1 = 1; i2 = 0; j2 = 1; k2 = 1;
+        } else if (x0 < z0) {
+            i1 = 0; j1 = 1; k1 = 0; i2 = 0; j2 = 1; k2 = 1;
+        } else {
+            i1 = 0; j1 = 1; k1 = 0; i2 = 1; j2 = 1; k2 = 0;
+        }
+    }
+
+    float x1 = x0 - i1 + G3;
+    float y1 = y0 - j1 + G3;
+    float z1 = z0 - k1 + G3;
+    float x2 = x0 - i2 + 2.0f * G3;
+    float y2 = y0 - j2 + 2.0f * G3;
+    float z2 = z0 - k2 + 2.0f * G3;
+    float x3 = x0 - 1.0f + 3.0f * G3;
+    float y3 = y0 - 1.0f + 3.0f * G3;
+    float z3 = z0 - 1.0f + 3.0f * G3;
+
+    int gi0 = _hash(perm, i + _hash(perm, j + _hash(perm, k)));
+    int gi1 = _hash(perm, i + i1 + _hash(perm, j + j1 + _hash(perm, k + k1)));
+    int gi2 = _hash(perm, i + i2 + _hash(perm, j + j2 + _hash(perm, k + k2)));
+    int gi3 = _hash(perm, i + 1 + _hash(perm, j + 1 + _hash(perm, k + 1)));
+
+    dx = 0.0f; dy = 0.0f; dz = 0.0f;
+    float n = cornerContribution(gi0, x0, y0, z0, dx, dy, dz)
+            + cornerContribution(gi1, x1, y1, z1, dx, dy, dz)
+            + cornerContribution(gi2, x2, y2, z2, dx, dy, dz)
+            + cornerContribution(gi3, x3, y3, z3, dx, dy, dz);
+
+    dx *= 32.0f; dy *= 32.0f; dz *= 32.0f;
+    return 32.0f * n;
+}
@@ -0,0 +1,275 @@
+#include <cstdint>
+
+#if defined(NOISE_SCALAR)
+#elif defined(__AVX2__)
+    #include <immintrin.h>
+    #define NOISE_AVX2
+#elif defined(__SSE2__)
+    #include <emmintrin.h>
+    #define NOISE_SSE2
+#elif defined(__wasm_simd128__)
+    #include <wasm_simd128.h>
+    #define NOISE_WASM_SIMD
+#endif
+
+
+// Batched simplex noise. noiseRow evaluates noise(x, y, z[i]) for count
+// points. Every point of a row goes through the same kernel, and the results
+// are bit-identical to the scalar noise() as long as floating point
+// contraction is disabled (-ffp-contract=off).
+void noiseRow(float x, float y, const float* z, float* out, uint32_t count, const uint8_t* perm = default_perm);
+
+
+// Each lane type wraps one instruction set behind the same small interface so
+// that the kernel below is written once. Masks are stored as float vectors
+// with all bits set where the comparison holds.
+
+#if defined(NOISE_AVX2)
+struct Lanes {
+    typedef __m256 f;
+    typedef __m256i i;
+    static const int width = 8;
+
+    static inline f set1(float a) { return _mm256_set1_ps(a); }
+    static inline i set1i(int32_t a) { return _mm256_set1_epi32(a); }
+    static inline f load(const float* a) { return _mm256_loadu_ps(a); }
+    static inline i loadi(const int32_t* a) { return _mm256_loadu_si256((const __m256i*)a); }
+    static inline void store(float* a, f b) { _mm256_storeu_ps(a, b); }
+    static inline void storei(int32_t* a, i b) { _mm256_storeu_si256((__m256i*)a, b); }
+
+    static inline f add(f a, f b) { return _mm256_add_ps(a, b); }
+    static inline f sub(f a, f b) { return _mm256_sub_ps(a, b); }
+    static inline f mul(f a, f b) { return _mm256_mul_ps(a, b); }
+    static inline f ge(f a, f b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    static inline f lt(f a, f b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static inline f bitAnd(f a, f b) { return _mm256_and_ps(a, b); }
+    static inline f bitOr(f a, f b) { return _mm256_or_ps(a, b); }
+    static inline f bitXor(f a, f b) { return _mm256_xor_ps(a, b); }
+    static inline f bitAndNot(f a, f b) { return _mm256_andnot_ps(b, a); } // a & ~b
+    static inline f select(f mask, f a, f b) { return _mm256_blendv_ps(b, a, mask); }
+
+    static inline i truncate(f a) { return _mm256_cvttps_epi32(a); }
+    static inline f toFloat(i a) { return _mm256_cvtepi32_ps(a); }
+    static inline i addi(i a, i b) { return _mm256_add_epi32(a, b); }
+    static inline i andi(i a, i b) { return _mm256_and_si256(a, b); }
+    static inline f eqi(i a, i b) { return _mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b)); }
+    static inline f lti(i a, i b) { return _mm256_castsi256_ps(_mm256_cmpgt_epi32(b, a)); }
+    static inline i maskToInt(f mask) { return _mm256_castps_si256(mask); }
+};
+#elif defined(NOISE_SSE2)
+struct Lanes {
+    typedef __m128 f;
+    typedef __m128i i;
+    static const int width = 4;
+
+    static inline f set1(float a) { return _mm_set1_ps(a); }
+    static inline i set1i(int32_t a) { return _mm_set1_epi32(a); }
+    static inline f load(const float* a) { return _mm_loadu_ps(a); }
+    static inline i loadi(const int32_t* a) { return _mm_loadu_si128((const __m128i*)a); }
+    static inline void store(float* a, f b) { _mm_storeu_ps(a, b); }
+    static inline void storei(int32_t* a, i b) { _mm_storeu_si128((__m128i*)a, b); }
+
+    static inline f add(f a, f b) { return _mm_add_ps(a, b); }
+    static inline f sub(f a, f b) { return _mm_sub_ps(a, b); }
+    static inline f mul(f a, f b) { return _mm_mul_ps(a, b); }
+    static inline f ge(f a, f b) { return _mm_cmpge_ps(a, b); }
+    static inline f lt(f a, f b) { return _mm_cmplt_ps(a, b); }
+    static inline f bitAnd(f a, f b) { return _mm_and_ps(a, b); }
+    static inline f bitOr(f a, f b) { return _mm_or_ps(a, b); }
+    static inline f bitXor(f a, f b) { return _mm_xor_ps(a, b); }
+    static inline f bitAndNot(f a, f b) { return _mm_andnot_ps(b, a); } // a & ~b
+    static inline f select(f mask, f a, f b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+
+    static inline i truncate(f a) { return _mm_cvttps_epi32(a); }
+    static inline f toFloat(i a) { return _mm_cvtepi32_ps(a); }
+    static inline i addi(i a, i b) { return _mm_add_epi32(a, b); }
+    static inline i andi(i a, i b) { return _mm_and_si128(a, b); }
+    static inline f eqi(i a, i b) { return _mm_castsi128_ps(_mm_cmpeq_epi32(a, b)); }
+    static inline f lti(i a, i b) { return _mm_castsi128_ps(_mm_cmplt_epi32(a, b)); }
+    static inline i maskToInt(f mask) { return _mm_castps_si128(mask); }
+};
+#elif defined(NOISE_WASM_SIMD)
+struct Lanes {
+    typedef v128_t f;
+    typedef v128_t i;
+    static const int width = 4;
+
+    static inline f set1(float a) { return wasm_f32x4_splat(a); }
+    static inline i set1i(int32_t a) { return wasm_i32x4_splat(a); }
+    static inline f load(const float* a) { return wasm_v128_load(a); }
+    static inline i loadi(const int32_t* a) { return wasm_v128_load(a); }
+    static inline void store(float* a, f b) { wasm_v128_store(a, b); }
+    static inline void storei(int32_t* a, i b) { wasm_v128_store(a, b); }
+
+    static inline f add(f a, f b) { return wasm_f32x4_add(a, b); }
+    static inline f sub(f a, f b) { return wasm_f32x4_sub(a, b); }
+    static inline f mul(f a, f b) { return wasm_f32x4_mul(a, b); }
+    static inline f ge(f a, f b) { return wasm_f32x4_ge(a, b); }
+    static inline f lt(f a, f b) { return wasm_f32x4_lt(a, b); }
+    static inline f bitAnd(f a, f b) { return wasm_v128_and(a, b); }
+    static inline f bitOr(f a, f b) { return wasm_v128_or(a, b); }
+    static inline f bitXor(f a, f b) { return wasm_v128_xor(a, b); }
+    static inline f bitAndNot(f a, f b) { return wasm_v128_andnot(a, b); } // a & ~b
+    static inline f select(f mask, f a, f b) { return wasm_v128_bitselect(a, b, mask); }
+
+    static inline i truncate(f a) { return wasm_i32x4_trunc_sat_f32x4(a); }
+    static inline f toFloat(i a) { return wasm_f32x4_convert_i32x4(a); }
+    static inline i addi(i a, i b) { return wasm_i32x4_add(a, b); }
+    static inline i andi(i a, i b) { return wasm_v128_and(a, b); }
+    static inline f eqi(i a, i b) { return wasm_i32x4_eq(a, b); }
+    static inline f lti(i a, i b) { return wasm_i32x4_lt(a, b); }
+    static inline i maskToInt(f mask) { return mask; }
+};
+#endif
+
+
+#if defined(NOISE_AVX2) || defined(NOISE_SSE2) || defined(NOISE_WASM_SIMD)
+
+typedef Lanes::f lanes_f;
+typedef Lanes::i lanes_i;
+
+
+// Same as fastfloor: truncate, then step down where truncation rounded up
+static inline lanes_i fastfloorLanes(lanes_f fp) {
+    lanes_i i = Lanes::truncate(fp);
+    return Lanes::addi(i, Lanes::maskToInt(Lanes::lt(fp, Lanes::toFloat(i))));
+}
+
+
+// Same as grad, with the branches turned into lane selects. The gradient
+// index is already reduced modulo 12.
+static inline lanes_f gradLanes(lanes_i h, lanes_f x, lanes_f y, lanes_f z) {
+    const lanes_f sign = Lanes::set1(-0.0f);
+
+    lanes_f u = Lanes::select(Lanes::lti(h, Lanes::set1i(8)), x, y);
+    lanes_f v = Lanes::select(Lanes::lti(h, Lanes::set1i(4)), y, z);
+
+    lanes_i one = Lanes::set1i(1);
+    lanes_i two = Lanes::set1i(2);
+    u = Lanes::bitXor(u, Lanes::bitAnd(Lanes::eqi(Lanes::andi(h, one), one), sign));
+    v = Lanes::bitXor(v, Lanes::bitAnd(Lanes::eqi(Lanes::andi(h, two), two), sign));
+
+    return Lanes::add(u, v);
+}
+
+
+static inline lanes_f cornerLanes(lanes_i _hash, lanes_f x, lanes_f y, lanes_f z) {
+    lanes_f t = Lanes::sub(Lanes::sub(Lanes::sub(Lanes::set1(0.6f), Lanes::mul(x, x)), Lanes::mul(y, y)), Lanes::mul(z, z));
+    lanes_f t2 = Lanes::mul(t, t);
+    lanes_f n = Lanes::mul(Lanes::mul(t2, t2), gradLanes(_hash, x, y, z));
+    return Lanes::bitAndNot(n, Lanes::lt(t, Lanes::set1(0.0f)));
+}
+
+
+static inline lanes_f noiseLanes(lanes_f x, lanes_f y, lanes_f z, const uint8_t* perm) {
+    static const float F3 = 1.0f / 3.0f;
+    static const float G3 = 1.0f / 6.0f;
+
+    lanes_f s = Lanes::mul(Lanes::add(Lanes::add(x, y), z), Lanes::set1(F3));
+    lanes_i i = fastfloorLanes(Lanes::add(x, s));
+    lanes_i j = fastfloorLanes(Lanes::add(y, s));
+    lanes_i k = fastfloorLanes(Lanes::add(z, s));
+    lanes_f t = Lanes::mul(Lanes::toFloat(Lanes::addi(Lanes::addi(i, j), k)), Lanes::set1(G3));
+    lanes_f x0 = Lanes::sub(x, Lanes::sub(Lanes::toFloat(i), t));
+    lanes_f y0 = Lanes::sub(y, Lanes::sub(Lanes::toFloat(j), t));
+    lanes_f z0 = Lanes::sub(z, Lanes::sub(Lanes::toFloat(k), t));
+
+    // Simplex ordering without branches, equivalent to the if/else tree of noise()
+    lanes_f x_ge_y = Lanes::ge(x0, y0);
+    lanes_f y_ge_z = Lanes::ge(y0, z0);
+    lanes_f x_ge_z = Lanes::ge(x0, z0);
+
+    const lanes_f all = Lanes::eqi(Lanes::set1i(0), Lanes::set1i(0));
+
+    lanes_f i1 = Lanes::bitAnd(x_ge_y, x_ge_z);
+    lanes_f j1 = Lanes::bitAndNot(y_ge_z, x_ge_y);
+    lanes_f k1 = Lanes::bitAndNot(all, Lanes::bitOr(i1, j1));
+    lanes_f i2 = Lanes::bitOr(x_ge_y, x_ge_z);
+    lanes_f j2 = Lanes::bitOr(Lanes::bitAndNot(all, x_ge_y), y_ge_z);
+    lanes_f k2 = Lanes::bitAndNot(all, Lanes::bitAnd(y_ge_z, x_ge_z));
+
+    const lanes_f one = Lanes::set1(1.0f);
+    const lanes_f g3 = Lanes::set1(G3);
+    const lanes_f g3_2 = Lanes::set1(2.0f * G3);
+    const lanes_f g3_3 = Lanes::set1(3.0f * G3);
+
+    lanes_f x1 = Lanes::add(Lanes::sub(x0, Lanes::bitAnd(i1, one)), g3);
+    lanes_f y1 = Lanes::add(Lanes::sub(y0, Lanes::bitAnd(j1, one)), g3);
+    lanes_f z1 = Lanes::add(Lanes::sub(z0, Lanes::bitAnd(k1, one)), g3);
+    lanes_f x2 = Lanes::add(Lanes::sub(x0, Lanes::bitAnd(i2, one)), g3_2);
+    lanes_f y2 = Lanes::add(Lanes::sub(y0, Lanes::bitAnd(j2, one)), g3_2);
+    lanes_f z2 = Lanes::add(Lanes::sub(z0, Lanes::bitAnd(k2, one)), g3_2);
+    lanes_f x3 = Lanes::add(Lanes::sub(x0, one), g3_3);
+    lanes_f y3 = Lanes::add(Lanes::sub(y0, one), g3_3);
+    lanes_f z3 = Lanes::add(Lanes::sub(z0, one), g3_3);
+
+    // The permutation lookups stay scalar, one lane at a time
+    int32_t lane_i[Lanes::width], lane_j[Lanes::width], lane_k[Lanes::width];
+    int32_t lane_i1[Lanes::width], lane_j1[Lanes::width], lane_k1[Lanes::width];
+    int32_t lane_i2[Lanes::width], lane_j2[Lanes::width], lane_k2[Lanes::width];
+    int32_t gi0[Lanes::width], gi1[Lanes::width], gi2[Lanes::width], gi3[Lanes::width];
+
+    Lanes::storei(lane_i, i);
+    Lanes::storei(lane_j, j);
+    Lanes::storei(lane_k, k);
+    Lanes::storei(lane_i1, Lanes::maskToInt(i1));
+    Lanes::storei(lane_j1, Lanes::maskToInt(j1));
+    Lanes::storei(lane_k1, Lanes::maskToInt(k1));
+    Lanes::storei(lane_i2, Lanes::maskToInt(i2));
+    Lanes::storei(lane_j2, Lanes::maskToInt(j2));
+    Lanes::storei(lane_k2, Lanes::maskToInt(k2));
+
+    for (int lane = 0; lane < Lanes::width; lane++) {
+        int32_t li = lane_i[lane], lj = lane_j[lane], lk = lane_k[lane];
+        // Masks are -1 where set
+        gi0[lane] = _hash(perm, li + _hash(perm, lj + _hash(perm, lk))) % 12;
+        gi1[lane] = _hash(perm, li - lane_i1[lane] + _hash(perm, lj - lane_j1[lane] + _hash(perm, lk - lane_k1[lane]))) % 12;
+        gi2[lane] = _hash(perm, li - lane_i2[lane] + _hash(perm, lj - lane_j2[lane] + _hash(perm, lk - lane_k2[lane]))) % 12;
+        gi3[lane] = _hash(perm, li + 1 + _hash(perm, lj + 1 + _hash(perm, lk + 1))) % 12;
+    }
+
+    lanes_f n0 = cornerLanes(Lanes::loadi(gi0), x0, y0, z0);
+    lanes_f n1 = cornerLanes(Lanes::loadi(gi1), x1, y1, z1);
+    lanes_f n2 = cornerLanes(Lanes::loadi(gi2), x2, y2, z2);
+    lanes_f n3 = cornerLanes(Lanes::loadi(gi3), x3, y3, z3);
+
+    return Lanes::mul(Lanes::set1(32.0f), Lanes::add(Lanes::add(Lanes::add(n0, n1), n2), n3));
+}
+
+
+void noiseRow(float x, float y, const float* z, float* out, uint32_t count, const uint8_t* perm) {
+    lanes_f x_lanes = Lanes::set1(x);
+    lanes_f y_lanes = Lanes::set1(y);
+
+    uint32_t idx = 0;
+    for (; idx + Lanes::width <= count; idx += Lanes::width) {
+        Lanes::store(out + idx, noiseLanes(x_lanes, y_lanes, Lanes::load(z + idx), perm));
+    }
+
+    // The tail goes through the same kernel, padded with its last point, so a
+    // sample never depends on where it falls in its row. Neighbouring chunks
+    // then agree on their shared samples even where compiler contraction
+    // makes the scalar and vector code round differently.
+    if (idx < count) {
+        float z_tail[Lanes::width];
+        float out_tail[Lanes::width];
+        for (uint32_t lane = 0; lane < (uint32_t)Lanes::width; lane++) {
+            z_tail[lane] = z[idx + lane < count ? idx + lane : count - 1];
+        }
+
+        Lanes::store(out_tail, noiseLanes(x_lanes, y_lanes, Lanes::load(z_tail), perm));
+        for (uint32_t lane = 0; idx + lane < count; lane++) {
+            out[idx + lane] = out_tail[lane];
+        }
+    }
+}
+
+#else
+
+void noiseRow(float x, float y, const float* z, float* out, uint32_t count, const uint8_t* perm) {
+    for (uint32_t idx = 0; idx < count; idx++) {
+        out[idx] = noise(x, y, z[idx], perm);
+    }
+}
+
+#endif
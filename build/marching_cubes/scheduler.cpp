@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Emscripten without -pthread has no threads to start. The chunk pool then
+// has no workers and its tasks run when the batch API is polled or waited on.
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+    #define CHUNK_POOL_NO_THREADS
+#endif
+
+
+// Fixed set of worker threads, each with its own task deque. A worker pops
+// the newest task of its own deque and steals the oldest task of the others
+// when it runs dry. A pool of 0 threads keeps a single deque that is only
+// drained by runQueued.
+class WorkStealingPool {
+public:
+    typedef std::function<void(uint32_t)> Task;
+
+    explicit WorkStealingPool(uint32_t n_threads) {
+        uint32_t n_queues = n_threads > 0 ? n_threads : 1;
+
+        for (uint32_t worker = 0; worker < n_queues; worker++) {
+            queues.emplace_back(new WorkerQueue());
+        }
+        for (uint32_t worker = 0; worker < n_threads; worker++) {
+            threads.emplace_back(&WorkStealingPool::run, this, worker);
+        }
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+    uint32_t size() const {
+        return queues.size();
+    }
+
+    bool hasThreads() const {
+        return !threads.empty();
+    }
+
+    // Runs one queued task on the calling thread, as worker 0. Returns false
+    // when nothing is queued.
+    bool runQueued() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_lock);
+            if (n_queued == 0) {
+                return false;
+            }
+            n_queued--;
+        }
+
+        Task task;
+        while (!take(0, task)) {
+            std::this_thread::yield();
+        }
+        task(0);
+        return true;
+    }
+
+    // Queues a task on the given worker, or round robin when worker is -1.
+    // Tasks receive the index of the worker running them.
+    void submit(Task task, int32_t worker = -1) {
+        if (worker < 0) {
+            worker = next_queue.fetch_add(1) % queues.size();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(queues[worker]->lock);
+            queues[worker]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleep_lock);
+            n_queued++;
+        }
+        wake.notify_one();
+    }
+
+private:
+    struct WorkerQueue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> threads;
+    std::atomic<uint32_t> next_queue {0};
+
+    std::mutex sleep_lock;
+    std::condition_variable wake;
+    uint32_t n_queued = 0;
+    bool stopping = false;
+
+    bool take(uint32_t worker, Task& task) {
+        for (uint32_t offset = 0; offset < queues.size(); offset++) {
+            WorkerQueue& queue = *queues[(worker + offset) % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.lock);
+            if (queue.tasks.empty()) {
+                continue;
+            }
+
+            if (offset == 0) {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            } else {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void run(uint32_t worker) {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(sleep_lock);
+                wake.wait(lock, [this]() { return stopping || n_queued > 0; });
+                if (n_queued == 0) {
+                    return;
+                }
+                n_queued--;
+            }
+
+            // A task is reserved for us, it may just not be visible in a deque yet
+            Task task;
+            while (!take(worker, task)) {
+                std::this_thread::yield();
+            }
+            task(worker);
+        }
+    }
+};
+
+
+WorkStealingPool& getChunkPool() {
+#if defined(CHUNK_POOL_NO_THREADS)
+    static WorkStealingPool pool(0);
+#else
+    static WorkStealingPool pool(std::max(std::thread::hardware_concurrency(), 1u));
+#endif
+    return pool;
+}
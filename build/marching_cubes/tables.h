@@ -37,6 +37,24 @@ uint16_t edgeTable[256] = {
 };
 
 
+// For each cube edge: offset of the lattice point the edge starts from, and
+// the axis it runs along (0 = x, 1 = y, 2 = z). Edges are always oriented from
+// the lower to the higher corner, so neighbouring cubes agree on their vertex.
+uint8_t edgeOrigin[12][4] = {
+	{0, 0, 0, 0}, {1, 0, 0, 1}, {0, 1, 0, 0}, {0, 0, 0, 1},
+	{0, 0, 1, 0}, {1, 0, 1, 1}, {0, 1, 1, 0}, {0, 0, 1, 1},
+	{0, 0, 0, 2}, {1, 0, 0, 2}, {1, 1, 0, 2}, {0, 1, 0, 2}
+};
+
+
+// Lattice points around a face of a transition block, as (u, v) offsets in
+// units of fine cubes. Counter-clockwise around the face normal u x v; even
+// entries are corners and odd entries edge midpoints.
+uint8_t blockFaceRing[8][2] = {
+	{0, 0}, {1, 0}, {2, 0}, {2, 1}, {2, 2}, {1, 2}, {0, 2}, {0, 1}
+};
+
+
 int8_t triTable[4096] = {
     -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
      0,  8,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
@@ -0,0 +1,538 @@
+// Meshes a fixed set of chunks through every entry point and compares a hash of
+// the output to the golden file, then checks the properties the mesher relies
+// on. Run with --update to rewrite the golden file after an intended change of
+// the output.
+//
+//     golden_test <golden file> [--update]
+
+#include "marching_cubes.cpp"
+
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+
+
+// Vertex, triangle counts and FNV-1a hash of the output of a case
+struct Digest {
+    uint n_vertices = 0;
+    uint n_triangles = 0;
+    uint32_t hash = 2166136261u;
+    bool stats_valid = true;
+
+    void add(const void* data, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t idx = 0; idx < size; idx++) {
+            hash = (hash ^ bytes[idx]) * 16777619u;
+        }
+    }
+
+    void add(const GeometryAttributes& geometry_attributes) {
+        add(geometry_attributes.positions, geometry_attributes.positions_size * sizeof(float));
+        add(geometry_attributes.normals, geometry_attributes.normals_size * sizeof(float));
+        add(geometry_attributes.indices, geometry_attributes.indices_size * sizeof(uint));
+
+        const MeshStats& stats = geometry_attributes.stats;
+        stats_valid &= stats.n_vertices * 3 == geometry_attributes.positions_size;
+        stats_valid &= stats.n_triangles * 3 == geometry_attributes.indices_size;
+        stats_valid &= stats.cells_skipped <= stats.cells_total;
+
+        n_vertices += stats.n_vertices;
+        n_triangles += stats.n_triangles;
+    }
+};
+
+
+typedef Digest (*Case)(const DensityFunction& density_function);
+
+const int CHUNK_MIN_Y = -3;
+const int CHUNK_MAX_Y = 1;
+
+
+Digest meshRange(const DensityFunction& density_function, uint n_vertices, float threshold, int chunk_min_y, int chunk_max_y) {
+    Digest digest;
+    MeshContext* mesh_context = createMeshContext();
+
+    for (int chunk_x = 0; chunk_x < 2; chunk_x++) {
+        for (int chunk_y = chunk_min_y; chunk_y <= chunk_max_y; chunk_y++) {
+            for (int chunk_z = 0; chunk_z < 2; chunk_z++) {
+                digest.add(*meshChunk(
+                    mesh_context,
+                    chunk_x, chunk_y, chunk_z,
+                    n_vertices, n_vertices, n_vertices,
+                    10.0f, 10.0f, 10.0f,
+                    &density_function,
+                    threshold
+                ));
+            }
+        }
+    }
+
+    deleteMeshContext(mesh_context);
+    return digest;
+}
+
+
+Digest meshSurface16(const DensityFunction& density_function) {
+    return meshRange(density_function, 16, 0.2f, CHUNK_MIN_Y, CHUNK_MAX_Y);
+}
+
+
+Digest meshSurface32(const DensityFunction& density_function) {
+    return meshRange(density_function, 32, -0.2f, CHUNK_MIN_Y, CHUNK_MAX_Y);
+}
+
+
+Digest meshCaves(const DensityFunction& density_function) {
+    return meshRange(density_function, 16, 0.6f, -8, -6);
+}
+
+
+Digest meshAir(const DensityFunction& density_function) {
+    return meshRange(density_function, 16, 0.2f, 5, 6);
+}
+
+
+Digest meshSolid(const DensityFunction& density_function) {
+    return meshRange(density_function, 16, 0.2f, -11, -10);
+}
+
+
+// Same chunks as meshSurface16, results taken in input order
+Digest meshBatch(const DensityFunction& density_function) {
+    vector<int> chunk_coords;
+    for (int chunk_x = 0; chunk_x < 2; chunk_x++) {
+        for (int chunk_y = CHUNK_MIN_Y; chunk_y <= CHUNK_MAX_Y; chunk_y++) {
+            for (int chunk_z = 0; chunk_z < 2; chunk_z++) {
+                chunk_coords.insert(chunk_coords.end(), { chunk_x, chunk_y, chunk_z });
+            }
+        }
+    }
+    uint n_chunks = chunk_coords.size() / 3;
+
+    ChunkBatch* chunk_batch = startChunkBatch(
+        chunk_coords.data(), n_chunks,
+        16, 16, 16,
+        10.0f, 10.0f, 10.0f,
+        &density_function,
+        0.2f
+    );
+    while (waitChunkBatch(chunk_batch)) {}
+
+    Digest digest;
+    for (ChunkResult& result : chunk_batch->results) {
+        digest.add(*result.geometry_attributes);
+        releaseGeometry(result.geometry_attributes);
+    }
+
+    deleteChunkBatch(chunk_batch);
+    return digest;
+}
+
+
+// A lod 0 chunk between coarser neighbours on +x and -z, and the lod 1 chunks
+Digest meshLod(const DensityFunction& density_function) {
+    Digest digest;
+    MeshContext* mesh_context = createMeshContext();
+
+    const uint fine_neighbours[6] = { 0, 1, 0, 0, 1, 0 };
+    const uint coarse_neighbours[6] = { 1, 1, 1, 1, 1, 1 };
+
+    for (int chunk_y = CHUNK_MIN_Y; chunk_y <= CHUNK_MAX_Y; chunk_y++) {
+        digest.add(*meshChunkLod(mesh_context, 0, chunk_y, 0, 32, 32, 32, 10.0f, 10.0f, 10.0f, 0, fine_neighbours, &density_function, 0.2f));
+        digest.add(*meshChunkLod(mesh_context, 1, chunk_y, 0, 32, 32, 32, 10.0f, 10.0f, 10.0f, 1, coarse_neighbours, &density_function, 0.2f));
+        digest.add(*meshChunkLod(mesh_context, 0, chunk_y, -1, 32, 32, 32, 10.0f, 10.0f, 10.0f, 1, coarse_neighbours, &density_function, 0.2f));
+    }
+
+    deleteMeshContext(mesh_context);
+    return digest;
+}
+
+
+// Threshold sweep over cached density grids, with a budget of a few chunks
+Digest meshCached(const DensityFunction& density_function) {
+    Digest digest;
+    MeshContext* mesh_context = createMeshContext();
+    DensityCache* density_cache = createDensityCache(3 * 17 * 17 * 17 * sizeof(float));
+
+    for (float threshold : { 0.2f, -0.2f, 0.2f }) {
+        for (int chunk_y = CHUNK_MIN_Y; chunk_y <= CHUNK_MAX_Y; chunk_y++) {
+            digest.add(*meshChunkCached(
+                mesh_context, density_cache,
+                0, chunk_y, 0,
+                16, 16, 16,
+                10.0f, 10.0f, 10.0f,
+                &density_function,
+                threshold
+            ));
+        }
+    }
+
+    deleteDensityCache(density_cache);
+    deleteMeshContext(mesh_context);
+    return digest;
+}
+
+
+// Samples shared by neighbouring chunks must be identical wherever they fall
+// in a noise row, or the meshes crack along the chunk boundary. 21 samples per
+// row leave a partial tail for every lane width.
+bool checkSharedSamples(const DensityFunction& density_function) {
+    const uint n_vertices = 20;
+    const uint stride_y = n_vertices + 1;
+    const uint stride_x = (n_vertices + 1) * stride_y;
+
+    MeshContext mesh_context;
+    vector<float> density;
+    fillDensityGrid(density, mesh_context, density_function, 0, -1, 0, n_vertices, n_vertices, n_vertices, 1);
+    DensityGrid grid = { density.data(), stride_x, stride_y };
+
+    bool valid = true;
+    for (uint8_t axis = 0; axis < 3; axis++) {
+        vector<float> neighbour_density;
+        fillDensityGrid(
+            neighbour_density, mesh_context, density_function,
+            axis == 0, -1 + (axis == 1), axis == 2,
+            n_vertices, n_vertices, n_vertices,
+            1
+        );
+        DensityGrid neighbour = { neighbour_density.data(), stride_x, stride_y };
+
+        for (uint u = 0; u <= n_vertices; u++) {
+            for (uint v = 0; v <= n_vertices; v++) {
+                uint own[3], other[3];
+                own[axis] = n_vertices;
+                other[axis] = 0;
+                own[(axis + 1) % 3] = other[(axis + 1) % 3] = u;
+                own[(axis + 2) % 3] = other[(axis + 2) % 3] = v;
+
+                valid &= grid.at(own[0], own[1], own[2]) == neighbour.at(other[0], other[1], other[2]);
+            }
+        }
+    }
+    return valid;
+}
+
+
+// Values of createNoise() in scripts/marching_cubes/noise.js with the default
+// noise_param, from node with the alea and simplex-noise packages
+const float noise_js_values[][4] = {
+    { 0.3125f, -1.25f, 0.6875f, 0.0916477353f },
+    { 1.5f, 0.25f, -2.75f, -0.0000202612505f },
+    { -3.0625f, -6.375f, 2.1875f, -0.298723076f },
+    { 0.0f, 0.0f, 0.0f, -0.200000000f },
+    { 0.5f, -0.5f, 0.5f, -0.0393769783f },
+    { 12.25f, -3.5f, -7.75f, -0.948624460f },
+    { -5.125f, 1.875f, 9.5f, -0.628360705f },
+    { 2.0625f, 3.5f, -1.125f, -0.932354090f },
+    { -0.875f, -7.5f, -0.375f, 0.611926002f },
+    { 7.4375f, -2.125f, 3.8125f, 0.470465391f },
+    { -9.75f, -4.625f, -6.0625f, 0.00815485367f },
+    { 3.3125f, -0.0625f, 15.5f, -0.787181224f },
+    { -1.5f, 2.75f, -3.25f, -0.794177756f },
+    { 25.125f, -5.875f, -30.5f, -0.315588540f },
+    { 0.0625f, -8.25f, 4.4375f, 1.00000000f },
+    { -17.5f, -1.0f, 11.25f, 0.288532417f },
+};
+
+
+// The native field must be the world of noise.js, which the JS side still uses
+// for collisions, up to float precision. Checks the scalar and row kernels.
+bool checkMatchesNoiseJs(const DensityFunction& density_function) {
+    const float tolerance = 1e-5f;
+
+    bool valid = true;
+    for (const float* point : noise_js_values) {
+        float row_value, scratch[2];
+        densityRow(density_function, point[0], point[1], &point[2], &row_value, 1, scratch);
+
+        valid &= fabs(density(density_function, point[0], point[1], point[2]) - point[3]) <= tolerance;
+        valid &= fabs(row_value - point[3]) <= tolerance;
+    }
+    return valid;
+}
+
+
+typedef array<float, 3> Point;
+
+// Edges of a mesh used by a single triangle, lying in the plane point[axis] == plane.
+// Vertices are welded by position.
+set<pair<Point, Point>> getOpenEdges(const GeometryAttributes& geometry_attributes, uint8_t axis, float plane) {
+    map<pair<Point, Point>, uint> edges;
+    for (uint idx = 0; idx < geometry_attributes.indices_size; idx += 3) {
+        for (uint corner = 0; corner < 3; corner++) {
+            const float* a = &geometry_attributes.positions[3 * geometry_attributes.indices[idx + corner]];
+            const float* b = &geometry_attributes.positions[3 * geometry_attributes.indices[idx + (corner + 1) % 3]];
+            Point p = { a[0], a[1], a[2] };
+            Point q = { b[0], b[1], b[2] };
+            if (p == q) continue;
+            if (q < p) swap(p, q);
+            edges[{ p, q }]++;
+        }
+    }
+
+    set<pair<Point, Point>> open_edges;
+    for (const auto& edge : edges) {
+        if (edge.second == 1 && edge.first.first[axis] == plane && edge.first.second[axis] == plane) {
+            open_edges.insert(edge.first);
+        }
+    }
+    return open_edges;
+}
+
+
+// A lod 0 chunk and each of its coarser lod 1 neighbours must cut their shared
+// plane along the same segments, including where several coarser faces meet
+bool checkLodSeams(const DensityFunction& density_function) {
+    const uint n_vertices = 32;
+    const float chunk_size = 10.0f;
+    const uint coarse_neighbours[6] = { 1, 1, 1, 1, 1, 1 };
+    const uint8_t face_sets[] = { 0x02, 0x11, 0x25, 0x3f };
+
+    MeshContext* mesh_context = createMeshContext();
+    bool valid = true;
+
+    for (uint8_t faces : face_sets) {
+        uint neighbour_lods[6];
+        for (uint8_t face = 0; face < 6; face++) {
+            neighbour_lods[face] = (faces >> face) & 1;
+        }
+
+        for (float threshold : { -0.2f, 0.2f, 0.6f }) {
+            for (int chunk_y = CHUNK_MIN_Y; chunk_y <= CHUNK_MAX_Y; chunk_y++) {
+                GeometryAttributes* fine = copyGeometryAttributes(*meshChunkLod(
+                    mesh_context, 0, chunk_y, 0,
+                    n_vertices, n_vertices, n_vertices,
+                    chunk_size, chunk_size, chunk_size,
+                    0, neighbour_lods, &density_function, threshold
+                ));
+
+                for (uint8_t face = 0; face < 6; face++) {
+                    if (!neighbour_lods[face]) continue;
+
+                    uint8_t axis = face / 2;
+                    int offset[3] = { 0, 0, 0 };
+                    offset[axis] = (face & 1) ? 1 : -1;
+                    float plane = (face & 1) ? chunk_size * (axis == 1 ? chunk_y + 1 : 1) : chunk_size * (axis == 1 ? chunk_y : 0);
+
+                    const GeometryAttributes* coarse = meshChunkLod(
+                        mesh_context, offset[0], chunk_y + offset[1], offset[2],
+                        n_vertices, n_vertices, n_vertices,
+                        chunk_size, chunk_size, chunk_size,
+                        1, coarse_neighbours, &density_function, threshold
+                    );
+
+                    valid &= getOpenEdges(*fine, axis, plane) == getOpenEdges(*coarse, axis, plane);
+                }
+
+                releaseGeometry(fine);
+            }
+        }
+    }
+
+    deleteMeshContext(mesh_context);
+    return valid;
+}
+
+
+bool isSameGeometry(const GeometryAttributes& a, const GeometryAttributes& b) {
+    return a.positions_size == b.positions_size && a.normals_size == b.normals_size && a.indices_size == b.indices_size
+        && equal(a.positions, a.positions + a.positions_size, b.positions)
+        && equal(a.normals, a.normals + a.normals_size, b.normals)
+        && equal(a.indices, a.indices + a.indices_size, b.indices);
+}
+
+
+// Re-meshing a cached density grid must give the mesh of a full regeneration,
+// for hits, misses and grids evicted then sampled again
+bool checkCachedMatchesUncached(const DensityFunction& density_function) {
+    MeshContext* mesh_context = createMeshContext();
+    MeshContext* cached_context = createMeshContext();
+    DensityCache* density_cache = createDensityCache(3 * 17 * 17 * 17 * sizeof(float));
+    bool valid = true;
+
+    for (float threshold : { 0.2f, -0.2f, 0.6f, 0.2f }) {
+        for (int chunk_y = CHUNK_MIN_Y; chunk_y <= CHUNK_MAX_Y; chunk_y++) {
+            valid &= isSameGeometry(
+                *meshChunk(mesh_context, 0, chunk_y, 0, 16, 16, 16, 10.0f, 10.0f, 10.0f, &density_function, threshold),
+                *meshChunkCached(cached_context, density_cache, 0, chunk_y, 0, 16, 16, 16, 10.0f, 10.0f, 10.0f, &density_function, threshold)
+            );
+        }
+    }
+
+    deleteDensityCache(density_cache);
+    deleteMeshContext(cached_context);
+    deleteMeshContext(mesh_context);
+    return valid;
+}
+
+
+// Without coarser neighbours, meshChunkLod at lod 0 is meshChunk
+bool checkLodMatchesChunk(const DensityFunction& density_function) {
+    MeshContext* mesh_context = createMeshContext();
+    MeshContext* lod_context = createMeshContext();
+    const uint neighbour_lods[6] = { 0, 0, 0, 0, 0, 0 };
+    bool valid = true;
+
+    for (float threshold : { -0.2f, 0.2f, 0.6f }) {
+        for (int chunk_y = CHUNK_MIN_Y; chunk_y <= CHUNK_MAX_Y; chunk_y++) {
+            valid &= isSameGeometry(
+                *meshChunk(mesh_context, 0, chunk_y, 0, 16, 16, 16, 10.0f, 10.0f, 10.0f, &density_function, threshold),
+                *meshChunkLod(lod_context, 0, chunk_y, 0, 16, 16, 16, 10.0f, 10.0f, 10.0f, 0, neighbour_lods, &density_function, threshold)
+            );
+        }
+    }
+
+    deleteMeshContext(lod_context);
+    deleteMeshContext(mesh_context);
+    return valid;
+}
+
+
+// Normals must be unit vectors at every threshold of the GUI range, also where
+// the fBm sum is clamped or a mask flattens the field
+bool checkFiniteNormals(const DensityFunction& density_function) {
+    MeshContext* mesh_context = createMeshContext();
+    bool valid = true;
+
+    for (float threshold : { -0.99f, 0.99f, 1.0f }) {
+        for (int chunk_x = 0; chunk_x < 2; chunk_x++) {
+            for (int chunk_y = -9; chunk_y <= 3; chunk_y++) {
+                for (int chunk_z = 0; chunk_z < 2; chunk_z++) {
+                    const GeometryAttributes* geometry_attributes = meshChunk(
+                        mesh_context,
+                        chunk_x, chunk_y, chunk_z,
+                        16, 16, 16,
+                        10.0f, 10.0f, 10.0f,
+                        &density_function,
+                        threshold
+                    );
+
+                    for (uint idx = 0; idx < geometry_attributes->normals_size; idx += 3) {
+                        const float* normal = &geometry_attributes->normals[idx];
+                        float length = sqrt(normal[0]*normal[0] + normal[1]*normal[1] + normal[2]*normal[2]);
+                        valid &= fabs(length - 1.0f) < 1e-3f;
+                    }
+                }
+            }
+        }
+    }
+
+    deleteMeshContext(mesh_context);
+    return valid;
+}
+
+
+// A batch dropped after its first result must cancel the chunks not started
+// yet and release the undelivered ones. Chunks up in the air are finished as
+// soon as the batch starts, so some always are. Leaks show up under
+// LeakSanitizer.
+bool checkBatchDeletedEarly(const DensityFunction& density_function) {
+    vector<int> chunk_coords;
+    for (int chunk_x = 0; chunk_x < 4; chunk_x++) {
+        for (int chunk_y = CHUNK_MIN_Y; chunk_y <= 6; chunk_y++) {
+            for (int chunk_z = 0; chunk_z < 4; chunk_z++) {
+                chunk_coords.insert(chunk_coords.end(), { chunk_x, chunk_y, chunk_z });
+            }
+        }
+    }
+
+    ChunkBatch* chunk_batch = startChunkBatch(
+        chunk_coords.data(), chunk_coords.size() / 3,
+        16, 16, 16,
+        10.0f, 10.0f, 10.0f,
+        &density_function,
+        0.2f
+    );
+
+    ChunkResult* result = waitChunkBatch(chunk_batch);
+    bool valid = result && result->geometry_attributes;
+    if (valid) {
+        releaseGeometry(result->geometry_attributes);
+    }
+
+    deleteChunkBatch(chunk_batch);
+    return valid;
+}
+
+
+typedef bool (*Check)(const DensityFunction& density_function);
+
+const pair<const char*, Check> checks[] = {
+    { "matches_noise_js", checkMatchesNoiseJs },
+    { "shared_samples", checkSharedSamples },
+    { "finite_normals", checkFiniteNormals },
+    { "batch_deleted_early", checkBatchDeletedEarly },
+    { "lod_seams", checkLodSeams },
+    { "cached_matches_uncached", checkCachedMatchesUncached },
+    { "lod_matches_chunk", checkLodMatchesChunk },
+};
+
+
+const pair<const char*, Case> cases[] = {
+    { "surface_16", meshSurface16 },
+    { "surface_32", meshSurface32 },
+    { "caves_16", meshCaves },
+    { "air_16", meshAir },
+    { "solid_16", meshSolid },
+    { "batch_16", meshBatch },
+    { "lod_32", meshLod },
+    { "cached_16", meshCached },
+};
+
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <golden file> [--update]\n", argv[0]);
+        return 2;
+    }
+    bool update = argc > 2 && strcmp(argv[2], "--update") == 0;
+
+    DensityFunction* density_function = createDensityFunction(0, 3, 0.2f, 0.15f, 4.0f, 4.0f, 5.0f, -8.0f, 1.0f);
+
+    ostringstream output;
+    bool passed = true;
+    for (const pair<const char*, Case>& test_case : cases) {
+        Digest digest = test_case.second(*density_function);
+
+        char line[128];
+        snprintf(line, sizeof(line), "%s %u %u %08x\n", test_case.first, digest.n_vertices, digest.n_triangles, digest.hash);
+        output << line;
+
+        if (!digest.stats_valid) {
+            fprintf(stderr, "%s: stats do not match the geometry\n", test_case.first);
+            passed = false;
+        }
+    }
+
+    for (const pair<const char*, Check>& check : checks) {
+        if (!check.second(*density_function)) {
+            fprintf(stderr, "%s: check failed\n", check.first);
+            passed = false;
+        }
+    }
+    deleteDensityFunction(density_function);
+
+    if (update) {
+        ofstream(argv[1]) << output.str();
+        return passed ? 0 : 1;
+    }
+
+    ifstream golden_file(argv[1]);
+    if (!golden_file) {
+        fprintf(stderr, "cannot read %s\n", argv[1]);
+        return 1;
+    }
+    stringstream golden;
+    golden << golden_file.rdbuf();
+
+    if (golden.str() != output.str()) {
+        fprintf(stderr, "output differs from %s\nexpected:\n%s\ngot:\n%s", argv[1], golden.str().c_str(), output.str().c_str());
+        return 1;
+    }
+    return passed ? 0 : 1;
+}
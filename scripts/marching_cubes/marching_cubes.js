@@ -1,6 +1,6 @@
 import * as THREE from '../../build/three.module.js';
 import { edgeTable, triTable } from './tables.js';
-import { noise } from './noise.js';
+import { noise, noise_param } from './noise.js';
 
 
 const epsilon = 0.05;
@@ -219,12 +219,116 @@ export function createMarchingCubes(chunk_idx, n_vertices, chunk_size, threshold
 }
 
 
-export function __createMarchingCubes(chunk_idx, n_vertices, chunk_size, noise_frequency, threshold) {
+// The committed marching_cubes.wasm predates build/marching_cubes/marching_cubes.h
+// and only exports the legacy getGeometryAttributes, which samples single octave
+// noise at a given frequency. Until the module is rebuilt, the functions below
+// fall back to it: contexts, density functions and caches are then 0 and ignored.
+function isLegacyModule() {
+    return typeof wasm._meshChunk !== 'function';
+}
+
+
+// To be released with wasm._deleteMeshContext
+export function createWasmMeshContext() {
+    return isLegacyModule() ? 0 : wasm._createMeshContext();
+}
+
+
+// Native counterpart of createNoise, to be released with wasm._deleteDensityFunction
+export function createWasmDensityFunction(seed = 0) {
+    if (isLegacyModule())
+        return 0;
+
+    return wasm.ccall(
+        'createDensityFunction',
+        'number',
+        ['number', 'number', 'number', 'number', 'number', 'number', 'number', 'number', 'number'],
+        [
+            seed, noise_param.n_octaves,
+            noise_param.frequency, noise_param.persistence, noise_param.lacunarity,
+            noise_param.surface_level, noise_param.surface_transition_height,
+            noise_param.floor_level, noise_param.floor_transition_height
+        ]
+    );
+}
+
+
+// The mesh is written into buffers of the mesh context (createWasmMeshContext)
+// that the next call on the context overwrites, and growing the wasm memory
+// detaches any view of it. three.js only uploads attributes when it renders, so
+// the attributes are copied out of wasm memory here.
+// With a density cache (wasm._createDensityCache), density grids are reused
+// across calls, so threshold changes and chunks coming back skip the noise.
+export function __createMarchingCubes(mesh_context, chunk_idx, n_vertices, chunk_size, density_function, threshold, density_cache = 0) {
     if (n_vertices.x * n_vertices.y * n_vertices.z > N_VERTICES_MAX)
         throw new Error('Too much vertices : ' + n_vertices.x + ' x ' + n_vertices.y + ' x ' + n_vertices.z + ' = ' + n_vertices.x * n_vertices.y * n_vertices.z + ' > ' + N_VERTICES_MAX + ' (N_VERTICES_MAX)');
 
     let time = performance.now();
 
+    if (isLegacyModule())
+        return __createMarchingCubesLegacy(chunk_idx, n_vertices, chunk_size, threshold);
+
+    const pointer = density_cache ? wasm.ccall(
+        'meshChunkCached',
+        'number',
+        ['number', 'number', 'number', 'number', 'number', 'number', 'number', 'number', 'number', 'number', 'number', 'number', 'number'],
+        [
+            mesh_context, density_cache,
+            chunk_idx.x, chunk_idx.y, chunk_idx.z,
+            n_vertices.x, n_vertices.y, n_vertices.z,
+            chunk_size.x, chunk_size.y, chunk_size.z,
+            density_function,
+            threshold
+        ]
+    ) : wasm.ccall(
+        'meshChunk',
+        'number',
+        ['number', 'number', 'number', 'number', 'number', 'number', 'number', 'number', 'number', 'number', 'number', 'number'],
+        [
+            mesh_context,
+            chunk_idx.x, chunk_idx.y, chunk_idx.z,
+            n_vertices.x, n_vertices.y, n_vertices.z,
+            chunk_size.x, chunk_size.y, chunk_size.z,
+            density_function,
+            threshold
+        ]
+    );
+
+    const wasm_time = performance.now() - time;
+    time = performance.now(); 
+
+    const output = wasm.HEAP32.subarray(pointer / 4, pointer / 4 + 6);
+
+    const positions_pointer = output[0];
+    const positions_size = output[1];
+
+    const normals_pointer = output[2];
+    const normals_size = output[3];
+
+    const indices_pointer = output[4];
+    const indices_size = output[5];
+
+    const positions = wasm.HEAPF32.slice(positions_pointer / 4, positions_pointer / 4 + positions_size);
+    const normals = wasm.HEAPF32.slice(normals_pointer / 4, normals_pointer / 4 + normals_size);
+    const indices = wasm.HEAPU32.slice(indices_pointer / 4, indices_pointer / 4 + indices_size);
+
+    const geometry = new THREE.BufferGeometry();
+    geometry.setAttribute('position', new THREE.BufferAttribute(positions, 3));
+    geometry.setAttribute('normal', new THREE.BufferAttribute(normals, 3));
+    geometry.setIndex(new THREE.BufferAttribute(indices, 1));
+
+    const get_geometry_time = performance.now() - time;
+
+    return [ wasm_time, get_geometry_time ];
+
+    // return geometry;
+}
+
+
+function __createMarchingCubesLegacy(chunk_idx, n_vertices, chunk_size, threshold) {
+    let time = performance.now();
+
+    // The legacy module allocates the attributes and leaves them to the caller
     const pointer = wasm.ccall(
         'getGeometryAttributes',
         'number',
@@ -233,13 +337,13 @@ export function __createMarchingCubes(chunk_idx, n_vertices, chunk_size, noise_f
             chunk_idx.x, chunk_idx.y, chunk_idx.z,
             n_vertices.x, n_vertices.y, n_vertices.z,
             chunk_size.x, chunk_size.y, chunk_size.z,
-            noise_frequency.x, noise_frequency.y, noise_frequency.z,
+            noise_param.frequency, noise_param.frequency, noise_param.frequency,
             threshold
         ]
     );
 
     const wasm_time = performance.now() - time;
-    time = performance.now(); 
+    time = performance.now();
 
     const output = wasm.HEAP32.subarray(pointer / 4, pointer / 4 + 6);
 
@@ -252,9 +356,9 @@ export function __createMarchingCubes(chunk_idx, n_vertices, chunk_size, noise_f
     const indices_pointer = output[4];
     const indices_size = output[5];
 
-    const positions = Float32Array.from(wasm.HEAPF32.subarray(positions_pointer / 4, positions_pointer / 4 + positions_size));
-    const normals = Float32Array.from(wasm.HEAPF32.subarray(normals_pointer / 4, normals_pointer / 4 + normals_size));
-    const indices = Uint32Array.from(wasm.HEAPU32.subarray(indices_pointer / 4, indices_pointer / 4 + indices_size));
+    const positions = wasm.HEAPF32.slice(positions_pointer / 4, positions_pointer / 4 + positions_size);
+    const normals = wasm.HEAPF32.slice(normals_pointer / 4, normals_pointer / 4 + normals_size);
+    const indices = wasm.HEAPU32.slice(indices_pointer / 4, indices_pointer / 4 + indices_size);
 
     const geometry = new THREE.BufferGeometry();
     geometry.setAttribute('position', new THREE.BufferAttribute(positions, 3));
@@ -269,6 +373,4 @@ export function __createMarchingCubes(chunk_idx, n_vertices, chunk_size, noise_f
     const get_geometry_time = performance.now() - time;
 
     return [ wasm_time, get_geometry_time ];
-
-    // return geometry;
 }
\ No newline at end of file